@@ -26,5 +26,7 @@
 #include "cmw/core/mesh.hpp"
 #include "cmw/core/renderer.hpp"
 #include "cmw/core/resource_manager.hpp"
+#include "cmw/core/scene_graph.hpp"
 #include "cmw/core/text.hpp"
+#include "cmw/core/text_batch.hpp"
 #include "cmw/core/window.hpp"
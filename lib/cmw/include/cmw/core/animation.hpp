@@ -17,12 +17,17 @@
 
 #pragma once
 
+#include <cmath>
+#include <cstdint>
 #include <chrono>
 #include <functional>
+#include <limits>
 #include <utility>
+#include <vector>
 #include <glm/glm.hpp>
 
 #include "cmw/utils/time.hpp"
+#include "cmw/utils.hpp"
 
 namespace cmw {
 
@@ -45,7 +50,7 @@ template <typename Ret>
 class TemporalAnimation: public Animation<Ret, std::chrono::milliseconds> {
     public:
         using Unit  = std::chrono::milliseconds;
-        using Clock = std::chrono::system_clock;
+        using Clock = FrameTime; // Same time for every animation updated during a frame
 
     public:
         template <typename F>
@@ -63,7 +68,7 @@ template <typename Ret>
 class TimedAnimation: public Animation<Ret, std::chrono::milliseconds> {
     public:
         using Unit  = std::chrono::milliseconds;
-        using Clock = std::chrono::system_clock;
+        using Clock = FrameTime; // Same time for every animation updated during a frame
 
     public:
         template <typename F>
@@ -92,43 +97,147 @@ class TimedAnimation: public Animation<Ret, std::chrono::milliseconds> {
 using GeometricAnimation      = TemporalAnimation<glm::mat4>;
 using TimedGeometricAnimation = TimedAnimation<glm::mat4>;
 
-template <typename T>
-class AnimatedObject {
+// Evaluates all transform animations together, from a time sampled once per frame
+// Tracks live in parallel arrays, walked in a few flat loops without indirect calls, except for custom curves
+class AnimationSystem {
     public:
-        T object;
+        using Track = std::uint32_t;
+        static constexpr Track Invalid = std::numeric_limits<Track>::max();
+
+        enum class Easing: std::uint8_t {
+            Linear,
+            InQuad,
+            OutQuad,
+            InOutQuad,
+            InCubic,
+            OutCubic,
+            InOutCubic,
+            InOutSine,
+            Custom,
+        };
+
+        enum class Loop: std::uint8_t {
+            Once,
+            Repeat,
+            PingPong,
+        };
+
+        // Maps the progress in [0, 1] to the interpolation factor, for Easing::Custom
+        using Curve = float (*)(float);
+
+        // Applied as translation * rotation * scale
+        struct Transform {
+            glm::vec3 translation = glm::vec3(0.0f);
+            glm::vec3 scale       = glm::vec3(1.0f);
+            float rotation        = 0.0f; // Radians, around the z axis
+        };
+
+        struct TrackInfo {
+            Transform from, to;
+            float duration; // Seconds
+            Easing easing = Easing::Linear;
+            Loop loop     = Loop::Once;
+            Curve curve   = nullptr;
+            float delay   = 0.0f;
+        };
 
     public:
-        template <typename F, typename ...Args>
-        inline AnimatedObject(F &&f, Args &&...args):
-            object(std::forward<Args>(args)...), animation(std::forward<F>(f)) { }
+        // The track starts at the time of the last update, plus its delay
+        Track add(const TrackInfo &info);
+        void remove(Track track);
+        void restart(Track track, float delay = 0.0f);
+
+        // Samples every track at the given time, in seconds
+        void update(double time);
+
+        // Only up to date after update
+        inline const glm::mat4 &get_matrix(Track track) const { return this->matrices[this->slots[track]]; }
+        inline float get_factor(Track track) const { return this->factors[this->slots[track]]; }
+
+        inline bool is_finished(Track track) const {
+            auto slot = this->slots[track];
+            return (this->loops[slot] == Loop::Once) && (this->progress[slot] >= 1.0f);
+        }
 
-        inline glm::mat4 update() const {
-            return this->animation.update();
+        inline bool contains(Track track) const {
+            return (track < this->slots.size()) && (this->slots[track] != Invalid);
         }
 
+        inline std::size_t size()     const { return this->tracks.size(); }
+        inline double      get_time() const { return this->time; }
+
+        static inline float ease(Easing easing, float t) {
+            switch (easing) {
+                default:
+                case Easing::Linear:     return t;
+                case Easing::InQuad:     return t * t;
+                case Easing::OutQuad:    return t * (2.0f - t);
+                case Easing::InOutQuad:  return (t < 0.5f) ? 2.0f * t * t : -1.0f + (4.0f - 2.0f * t) * t;
+                case Easing::InCubic:    return t * t * t;
+                case Easing::OutCubic:   return (t - 1.0f) * (t - 1.0f) * (t - 1.0f) + 1.0f;
+                case Easing::InOutCubic: return (t < 0.5f) ? 4.0f * t * t * t : (t - 1.0f) * (2.0f * t - 2.0f) * (2.0f * t - 2.0f) + 1.0f;
+                case Easing::InOutSine:  return 0.5f - 0.5f * std::cos(t * 3.14159265f);
+            }
+        }
+
+    protected:
+        // Start times are relative to the first update, to keep float precision
+        inline float get_relative_time() const { return (float)(this->time - this->epoch); }
+
     protected:
-        GeometricAnimation animation;
+        double time = 0.0, epoch = 0.0;
+        bool started = false;
+
+        // Indexed by slot
+        std::vector<Track>     tracks;
+        std::vector<float>     starts, inv_durations;
+        std::vector<Easing>    easings;
+        std::vector<Loop>      loops;
+        std::vector<Curve>     curves;
+        std::vector<Transform> froms, tos;
+        std::vector<float>     progress, factors;
+        std::vector<glm::mat4> matrices;
+
+        // Indexed by track
+        std::vector<std::uint32_t> slots;
+        std::vector<Track>         free_tracks;
 };
 
+// Object drawn with the matrix of an animation track, which it owns
 template <typename T>
-class TimedAnimatedObject {
-    public:
-        template <typename F, typename ...Args>
-        inline TimedAnimatedObject(TimedGeometricAnimation::Unit timeout, F &&f, Args &&...args):
-            animation(timeout, std::forward<F>(f)), object(std::forward<Args>(args)...) { }
-
-        inline glm::mat4 &update() {
-            if (this->animation)
-                return this->model = this->animation.update();
-            return this->model;
-        }
+class AnimatedObject {
+    CMW_NON_COPYABLE(AnimatedObject);
+    CMW_NON_MOVEABLE(AnimatedObject);
 
     public:
         T object;
 
+    public:
+        template <typename ...Args>
+        inline AnimatedObject(AnimationSystem &system, const AnimationSystem::TrackInfo &info, Args &&...args):
+            object(std::forward<Args>(args)...), system(system), track(system.add(info)) { }
+
+        inline ~AnimatedObject() {
+            this->system.remove(this->track);
+        }
+
+        inline const glm::mat4 &update() const {
+            return this->system.get_matrix(this->track);
+        }
+
+        inline bool is_finished() const {
+            return this->system.is_finished(this->track);
+        }
+
+        inline void restart(float delay = 0.0f) {
+            this->system.restart(this->track, delay);
+        }
+
+        inline AnimationSystem::Track get_track() const { return this->track; }
+
     protected:
-        TimedGeometricAnimation animation;
-        glm::mat4 model;
+        AnimationSystem &system;
+        AnimationSystem::Track track;
 };
 
 } // namespace cmw
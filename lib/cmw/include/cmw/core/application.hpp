@@ -17,11 +17,15 @@
 
 #pragma once
 
+#include <cstdint>
+
+#include "cmw/core/animation.hpp"
 #include "cmw/core/imgui.hpp"
 #include "cmw/core/log.hpp"
 #include "cmw/core/renderer.hpp"
 #include "cmw/core/resource_manager.hpp"
 #include "cmw/core/window.hpp"
+#include "cmw/utils/time.hpp"
 
 namespace cmw {
 
@@ -44,11 +48,32 @@ class Application {
 
         static Application &get_instance() { return *instance; }
 
+        // Samples the clock for the frame and evaluates the animations, returns the time elapsed since the last frame
+        // in seconds. With a fixed timestep, every frame lasts exactly that step regardless of the wall time
+        inline float begin_frame() {
+            auto dt = this->clock.tick();
+            this->animations.update(this->clock.get_time());
+            return dt;
+        }
+
+        // Time of the current frame, as sampled by begin_frame
         template <typename T>
         inline T get_time() const {
-            return (T)glfwGetTime();
+            return (T)this->clock.get_time();
         }
 
+        inline float         get_dt()          const { return this->clock.get_dt(); }
+        inline std::uint64_t get_frame_index() const { return this->clock.get_frame_index(); }
+
+        // Zero goes back to the wall clock
+        inline void  set_fixed_timestep(float step) { this->clock.set_fixed_step(step); }
+        inline float get_fixed_timestep() const { return this->clock.get_fixed_step(); }
+
+        inline FrameClock       &get_clock()       { return this->clock; }
+        inline const FrameClock &get_clock() const { return this->clock; }
+
+        inline AnimationSystem       &get_animations()       { return this->animations; }
+        inline const AnimationSystem &get_animations() const { return this->animations; }
         inline Renderer       &get_renderer()       { return this->renderer; }
         inline const Renderer &get_renderer() const { return this->renderer; }
         inline ResourceManager       &get_resource_manager()       { return this->resource_manager; }
@@ -62,6 +87,9 @@ class Application {
         Window window;
         ResourceManager resource_manager;
         Renderer renderer;
+        AnimationSystem animations;
+
+        FrameClock clock;
 };
 
 } // namespace cmw
@@ -0,0 +1,105 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "cmw/utils/asset_view.hpp"
+#include "cmw/utils/mapped_file.hpp"
+#include "cmw/utils.hpp"
+
+namespace cmw {
+
+// Somewhere assets can be read from, looked up by their path relative to the asset root (eg. "shaders/mesh.vert")
+// open must be thread-safe, and return an empty view if the asset isn't found
+class AssetSource {
+    public:
+        virtual ~AssetSource() = default;
+
+        virtual AssetView open(const std::string &path) const = 0;
+        virtual bool contains(const std::string &path) const = 0;
+};
+
+// Loose files in a directory
+class DirectorySource: public AssetSource {
+    public:
+        inline DirectorySource(const std::string &root): root(root) { }
+
+        AssetView open(const std::string &path) const override;
+        bool contains(const std::string &path) const override;
+
+    protected:
+        std::string root;
+};
+
+// Single file archive, memory-mapped and indexed by path hash
+// Layout: header | entries sorted by hash | names | blobs, each aligned to Header::alignment
+// Uncompressed entries are returned as views into the mapping, compressed ones are decompressed into a buffer
+class ArchiveSource: public AssetSource {
+    public:
+        enum class Compression: std::uint32_t {
+            None,
+            Lz4,  // LZ4 block format
+            Zstd, // Reserved, not supported by the reader
+        };
+
+        struct Header {
+            std::uint32_t magic, version;
+            std::uint32_t nb_entries, alignment;
+            std::uint64_t names_offset, names_size;
+        };
+
+        struct Entry {
+            std::uint64_t hash;
+            std::uint64_t offset, size, original_size;
+            std::uint32_t name_offset, name_size;
+            Compression compression;
+            std::uint32_t reserved;
+        };
+
+        static constexpr std::uint32_t magic   = 0x41574d43; // "CMWA"
+        static constexpr std::uint32_t version = 1;
+
+        static constexpr inline std::uint64_t hash_path(std::string_view path) { return fnv1a(path); }
+
+    public:
+        ArchiveSource() = default;
+        inline ArchiveSource(const std::string &path) { load(path); }
+
+        // Returns false if the file doesn't exist or isn't a valid archive
+        bool load(const std::string &path);
+
+        AssetView open(const std::string &path) const override;
+        bool contains(const std::string &path) const override;
+
+        inline std::size_t size() const { return this->header ? this->header->nb_entries : 0; }
+        inline explicit operator bool() const { return this->header != nullptr; }
+
+    protected:
+        const Entry *find(const std::string &path) const;
+
+    protected:
+        MappedFile file;
+        const Header *header = nullptr;
+        const Entry  *entries = nullptr;
+        const char   *names   = nullptr;
+};
+
+} // namespace cmw
@@ -17,15 +17,21 @@
 
 #pragma once
 
+#include <cstdio>
 #include <cstdint>
+#include <algorithm>
 #include <array>
-#include <unordered_map>
-#include <functional>
+#include <string>
+#include <type_traits>
 #include <utility>
+#include <variant>
+#include <vector>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include "cmw/core/log.hpp"
 #include "cmw/utils/area.hpp"
+#include "cmw/utils/delegate.hpp"
 #include "cmw/utils/position.hpp"
 #include "cmw/utils.hpp"
 #include "cmw/platform.h"
@@ -251,16 +257,16 @@ struct KeyPressedEvent: public KeyEvent {
 struct KeyHeldEvent: public KeyEvent {
     DECL_EVENT_TYPE_GETTERS(KeyHeld)
 
-    inline KeyHeldEvent(int key, int mods): KeyEvent(key, mods) {
-        ++this->key_cnts[key];
-    }
+    // The count is taken when the event is created, as events are queued until the next process_events
+    inline KeyHeldEvent(int key, int mods): KeyEvent(key, mods), repeats(++key_cnts[key]) { }
 
-    inline int        get_repeats() const  { return key_cnts[get_key()]; }
+    inline int        get_repeats() const  { return this->repeats; }
     static inline int get_repeats(int key) { return key_cnts[key]; }
 
     static inline void reset_key(int key) { key_cnts[key] = 0; }
 
     protected:
+        int repeats;
         static inline std::array<std::uint32_t, Keys::KeyLast> key_cnts;
 };
 
@@ -315,16 +321,16 @@ struct MouseButtonPressedEvent: public KeyEvent {
 struct MouseButtonHeldEvent: public KeyEvent {
     DECL_EVENT_TYPE_GETTERS(MouseButtonHeld)
 
-    inline MouseButtonHeldEvent(int key, int mods): KeyEvent(key, mods) {
-        ++this->key_cnts[key];
-    }
+    // The count is taken when the event is created, as events are queued until the next process_events
+    inline MouseButtonHeldEvent(int key, int mods): KeyEvent(key, mods), repeats(++key_cnts[key]) { }
 
-    inline int        get_repeats() const  { return key_cnts[get_key()]; }
+    inline int        get_repeats() const  { return this->repeats; }
     static inline int get_repeats(int key) { return key_cnts[key]; }
 
     static inline void reset_key(int key) { key_cnts[key] = 0; }
 
     protected:
+        int repeats;
         static inline std::array<std::uint32_t, MouseButtons::Last> key_cnts;
 };
 
@@ -399,10 +405,27 @@ struct JoystickMovedEvent: public Event {
 
 #undef DECL_EVENT_TYPE_GETTERS
 
+// Tagged union of every event type, as stored in the input queue
+using AnyEvent = std::variant<std::monostate,
+    KeyPressedEvent, KeyHeldEvent, KeyReleasedEvent, CharTypedEvent,
+    MouseButtonPressedEvent, MouseButtonHeldEvent, MouseButtonReleasedEvent, MouseMovedEvent, MouseScrolledEvent,
+    WindowResizedEvent, WindowMovedEvent, WindowFocusedEvent, WindowDefocusedEvent, WindowClosedEvent,
+    JoystickMovedEvent>;
+
+// Events are queued by the GLFW callbacks, and dispatched once per frame by process_events (called by Window::update)
+// instead of from within glfwPollEvents
+// Consecutive mouse motion and scroll events are coalesced, so that high-rate mice produce one event per frame
 class InputManager {
     public:
         template <typename T = Event>
-        using Callback = std::function<void(T &)>;
+        using Callback = Delegate<void(T &)>;
+
+        struct MotionSample {
+            Position2f pos;
+            double time; // glfwGetTime
+        };
+
+        static constexpr std::size_t queue_capacity = 256;
 
         InputManager() {
 #ifdef CMW_SWITCH
@@ -411,6 +434,7 @@ class InputManager {
         }
 
         ~InputManager() {
+            stop_recording();
 #ifdef CMW_SWITCH
             hidExit();
 #endif
@@ -418,29 +442,78 @@ class InputManager {
 
         void set_window(GLFWwindow *window);
 
-        template <typename T>
-        std::size_t register_callback(Callback<T> cb) {
-            this->callbacks[(int)T::get_static_type()].insert({this->cur_handle, *(Callback<> *)&cb});
+        // Callbacks must not be registered or removed from a callback
+        template <typename T, typename F>
+        std::size_t register_callback(F &&cb) {
+            this->callbacks[(int)T::get_static_type()].push_back({this->cur_handle,
+                Callback<>([cb = std::forward<F>(cb)](Event &event) mutable { cb(static_cast<T &>(event)); })});
             return this->cur_handle++;
         }
 
         template <typename T>
         void remove_callback(std::size_t handle) {
-            this->callbacks[(int)T::get_static_type()].erase(handle);
+            auto &handlers = this->callbacks[(int)T::get_static_type()];
+            handlers.erase(std::remove_if(handlers.begin(), handlers.end(),
+                [handle](const auto &handler) { return handler.id == handle; }), handlers.end());
         }
 
+        // If the queue is full, the oldest event is dispatched right away to make room
         template <typename T>
-        void process(T event) const {
-            for (const auto &[id, cb]: this->callbacks[(int)event.get_type()])
-                cb(event);
+        void push(T &&event) {
+            using Type = std::decay_t<T>;
+            if constexpr (std::is_same_v<Type, MouseMovedEvent> || std::is_same_v<Type, MouseScrolledEvent>) {
+                auto *last = this->queue_size ? std::get_if<Type>(&back()) : nullptr;
+                if (this->coalesce && last) {
+                    if constexpr (std::is_same_v<Type, MouseMovedEvent>)
+                        *last = event;
+                    else
+                        *last = MouseScrolledEvent(last->get_x() + event.get_x(), last->get_y() + event.get_y());
+                    return;
+                }
+            }
+
+            if (this->queue_size == queue_capacity) {
+                CMW_WARN("Input queue full, dispatching early\n");
+                dispatch(pop());
+            }
+            this->queue[(this->queue_head + this->queue_size++) % queue_capacity] = std::forward<T>(event);
         }
 
-#ifndef CMW_SWITCH
-        void set_window(GLFWwindow *window) const;
-#endif
+        // Dispatches queued events in order, returns the number of events dispatched
+        std::size_t process_events();
+
+        template <typename T>
+        void dispatch(T &event) {
+            for (auto &handler: this->callbacks[(int)T::get_static_type()])
+                handler.cb(event);
+        }
+
+        inline std::size_t get_nb_queued_events() const { return this->queue_size; }
+
+        inline void set_coalescing(bool coalesce) { this->coalesce = coalesce; }
+        inline bool get_coalescing() const { return this->coalesce; }
+
+        // Every cursor sample of the frame, before coalescing, in window coordinates (origin at the bottom left)
+        // Filled during polling, and available from process_events until the next one
+        inline void set_keep_motion_history(bool keep) { this->keep_motion_history = keep; this->raw_motion.clear(); }
+        inline const std::vector<MotionSample> &get_motion_history() const { return this->motion_history; }
+
+        // Cached from the resize events, so that cursor samples don't query the window
+        inline const Areai &get_window_size() const { return this->window_size; }
+
+        // Writes every dispatched event with its frame index and time to a binary log, until stop_recording
+        bool start_recording(const std::string &path);
+        void stop_recording();
+        inline bool is_recording() const { return this->record_fp != nullptr; }
+
+        // Dispatches the events of a log instead of the window events, starting from the next frame
+        // Pair with a fixed timestep (see Application::set_fixed_timestep) to reproduce the recorded frames
+        bool start_replay(const std::string &path);
+        inline void stop_replay() { this->replay_log.clear(); this->replay_pos = 0; }
+        inline bool is_replaying() const { return this->replay_pos < this->replay_log.size(); }
 
 #ifdef CMW_SWITCH
-        void process_nx_events(GLFWwindow *window) const;
+        void process_nx_events(GLFWwindow *window);
 #endif
 
     private:
@@ -454,9 +527,57 @@ class InputManager {
         static void window_focus_cb(GLFWwindow *window, int focused);
         static void window_close_cb(GLFWwindow *window);
 
+        inline AnyEvent &back() {
+            return this->queue[(this->queue_head + this->queue_size - 1) % queue_capacity];
+        }
+
+        inline AnyEvent pop() {
+            auto event = std::move(this->queue[this->queue_head]);
+            this->queue_head = (this->queue_head + 1) % queue_capacity, --this->queue_size;
+            return event;
+        }
+
+        void dispatch(AnyEvent &&event);
+
     protected:
+        // Fixed-size, so that logs can be read back in one go
+        struct EventRecord {
+            std::uint32_t frame;
+            float time;        // Seconds since the recording started
+            EventType type;
+            std::uint8_t reserved[3]; // Explicit padding, zeroed so that logs are deterministic
+            std::int32_t a, b; // Key and mods, codepoint, window size or position, joystick side
+            float x, y;        // Mouse position or scroll offset, joystick position
+        };
+
+        struct LogHeader {
+            std::uint32_t magic, version;
+        };
+
+        static constexpr std::uint32_t log_magic   = 0x49574d43; // "CMWI"
+        static constexpr std::uint32_t log_version = 1;
+
+        static EventRecord encode(const AnyEvent &event);
+        static AnyEvent decode(const EventRecord &record);
+
+        struct Handler {
+            std::size_t id;
+            Callback<> cb;
+        };
+
         std::size_t cur_handle = 0;
-        std::array<std::unordered_map<std::size_t, Callback<>>, (std::size_t)EventType::Max> callbacks;
+        std::array<std::vector<Handler>, (std::size_t)EventType::Max> callbacks;
+        std::array<AnyEvent, queue_capacity> queue;
+        std::size_t queue_head = 0, queue_size = 0;
+        bool coalesce = true, keep_motion_history = false;
+        std::vector<MotionSample> raw_motion, motion_history;
+        Areai window_size = {};
+
+        std::uint32_t frame = 0;         // Frames processed since recording or replay started
+        double record_start = 0.0;
+        std::FILE *record_fp = nullptr;
+        std::vector<EventRecord> replay_log;
+        std::size_t replay_pos = 0;
 #ifdef CMW_SWITCH
         static constexpr float key_held_threshold = 0.5f; // Time (s) a key to to be held to begin firing KeyHeldEvents
 #endif
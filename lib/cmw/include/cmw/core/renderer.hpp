@@ -18,6 +18,10 @@
 #pragma once
 
 #include <cstdint>
+#include <algorithm>
+#include <array>
+#include <future>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 #include <glad/glad.h>
@@ -25,10 +29,15 @@
 #include "cmw/core/animation.hpp"
 #include "cmw/core/mesh.hpp"
 #include "cmw/core/resource_manager.hpp"
+#include "cmw/core/scene_graph.hpp"
 #include "cmw/core/text.hpp"
+#include "cmw/core/text_batch.hpp"
+#include "cmw/gl/buffer.hpp"
+#include "cmw/gl/framebuffer.hpp"
 #include "cmw/gl/shader_program.hpp"
 #include "cmw/shapes/shape.hpp"
 #include "cmw/utils/color.hpp"
+#include "cmw/utils/flat_map.hpp"
 #include "cmw/utils/position.hpp"
 #include "cmw/widgets/widget.hpp"
 
@@ -45,13 +54,16 @@ class Renderer {
         static constexpr std::size_t max_vertices  = 1000;
         static constexpr std::size_t max_indices   = 10000;
         static constexpr std::size_t max_textures  = 30;
+        static constexpr std::size_t max_texture_arrays = 2; // Bound after the textures, on units 30 and 31
+
+        class DrawList;
 
     private:
-        inline Font *find_font(char16_t chr) {
+        inline Font *find_font(char32_t chr) {
             for (auto &font: this->resource_man.get_fonts())
                 if (font->has_glyph(chr))
                     return font.get();
-            CMW_ERROR("Failed to find glyph %c (%#x)\n", chr, chr);
+            CMW_ERROR("Failed to find glyph %#x\n", (unsigned int)chr);
             return nullptr;
         }
 
@@ -59,7 +71,11 @@ class Renderer {
         Renderer(ResourceManager &resource_man);
 
         inline void clear(int flags) const {
-            glClearColor(this->clear_color.r, this->clear_color.g, this->clear_color.b, this->clear_color.a);
+            clear(flags, this->clear_color);
+        }
+
+        static inline void clear(int flags, const Colorf &color) {
+            glClearColor(color.r, color.g, color.b, color.a);
             glClear(flags);
         }
 
@@ -81,6 +97,20 @@ class Renderer {
 
         void end();
 
+        // Redirects the draws to a framebuffer of the given size until pop_target, flushing the current batch first
+        // A capture in progress is suspended meanwhile. The camera must outlive the target
+        template <typename T>
+        inline void push_target(gl::Framebuffer &framebuffer, T &&camera, GLsizei width, GLsizei height) {
+            push_target(framebuffer, camera.get_view_proj(), width, height);
+        }
+        void push_target(gl::Framebuffer &framebuffer, const glm::mat4 &view_proj, GLsizei width, GLsizei height);
+        void pop_target();
+
+        // Blends the following draws as premultiplied alpha, which is how render targets store their contents
+        // Targets are drawn to with straight alpha, with the coverage accumulated in their alpha channel
+        void set_premultiplied(bool premultiplied);
+        inline bool is_premultiplied() const { return this->premultiplied; }
+
         template <typename T>
         inline void submit(AnimatedObject<T> &element, RenderingMode mode = RenderingMode::Default) {
             submit(element.object, element.update(), mode);
@@ -98,41 +128,109 @@ class Renderer {
                 throw std::runtime_error("Wrong type for Renderer::submit");
         }
 
+        // Uses the cached world matrix of the node, SceneGraph::update must have been called
+        template <typename T>
+        inline void submit(T &&element, const SceneGraph &graph, SceneGraph::Node node,
+                RenderingMode mode = RenderingMode::Default) {
+            submit(std::forward<T>(element), graph.get_world(node), mode);
+        }
+
         void add_mesh(Mesh &mesh, const glm::mat4 &model, RenderingMode mode = RenderingMode::Default);
 
+        // Records the geometry emitted until end_capture into the list (cleared first), instead of the batch
+        // Captures can't be nested, but lists can be submitted while capturing
+        void begin_capture(DrawList &list);
+        void end_capture();
+        inline bool is_capturing() const { return this->capture != nullptr; }
+
+        // Appends recorded geometry to the batch, without rebuilding it
+        void submit(const DrawList &list);
+
+        // Builds the batch if it was modified since the last build, then appends all its quads
+        void submit(TextBatch &batch);
+
+        // Resolves the glyphs of the batch on the calling thread, then builds it on a worker
+        // The batch must not be modified or submitted until the future is ready
+        std::future<void> build_async(TextBatch &batch);
+
+        // Draws the image of a texture array layer, pos is its top-left corner
+        // Unlike plain textures, hundreds of layers can be drawn in a single batch (see ResourceManager::get_texture_layer)
+        void draw_texture(gl::Texture2d &texture, const Position &pos, float width, float height,
+            const Colorf &color = {1.0f, 1.0f, 1.0f});
+        void draw_texture_layer(const ResourceManager::TextureLayer &layer, const Position &pos, float width, float height,
+            const Colorf &color = {1.0f, 1.0f, 1.0f});
+
         void draw_glyph(Glyph &glyph, const Position &pos = {0, 0, 0}, float scale = 1.0f,
             const Colorf &color = {1.0f, 1.0f, 1.0f});
 
-        inline void draw_char(Font *font, char16_t chr, const Position &pos = {0, 0, 0}, float scale = 1.0f,
+        inline void draw_char(Font *font, char32_t chr, const Position &pos = {0, 0, 0}, float scale = 1.0f,
                 const Colorf &color = {1.0f, 1.0f, 1.0f}) {
-            if (font->has_glyph(chr))
-                draw_glyph(font->get_glyph(chr), pos, scale, color);
+            if (!font->has_glyph(chr))
+                return;
+            auto &glyph = font->get_glyph(chr);
+            record_page(font, glyph.get_page());
+            draw_glyph(glyph, pos, scale, color);
         }
-        inline void draw_char(char16_t chr, const Position &pos = {0, 0, 0}, float scale = 1.0f,
+        inline void draw_char(char32_t chr, const Position &pos = {0, 0, 0}, float scale = 1.0f,
                 const Colorf &color = {1.0f, 1.0f, 1.0f}) {
             if (auto *font = find_font(chr); font)
                 draw_char(font, chr, pos, scale, color);
         }
 
+        // Same font fallback as draw_string, but without emitting geometry
+        template <typename Str>
+        inline void layout_string(TextLayout &layout, Font *font, const Str &str, float scale = 1.0f, float max_width = 0.0f) {
+            layout.build(font, str, [this](char32_t chr) { return find_font(chr); }, scale, max_width);
+        }
+
+        template <typename Str>
+        inline Area measure_string(Font *font, const Str &str, float scale = 1.0f, float max_width = 0.0f) {
+            layout_string(this->text_layout, font, str, scale, max_width);
+            return this->text_layout.get_size();
+        }
+        template <typename Str>
+        inline Area measure_string(const Str &str, float scale = 1.0f, float max_width = 0.0f) {
+            return measure_string(nullptr, str, scale, max_width);
+        }
+
+        // pos is the pen position of the first line
+        void draw_layout(const TextLayout &layout, const Position &pos = {0, 0, 0}, const Colorf &color = {1.0f, 1.0f, 1.0f});
+
         // Uses specified font preferentially and falls back to others otherwise
-        void draw_string(Font *font, const std::u16string &str, const Position &pos = {0, 0, 0}, float scale = 1.0f,
+        // Strings are decoded as UTF-16 (including surrogate pairs) or UTF-8, without intermediate conversion
+        void draw_string(Font *font, std::u16string_view str, const Position &pos = {0, 0, 0}, float scale = 1.0f,
+            const Colorf &color = {1.0f, 1.0f, 1.0f});
+        void draw_string(Font *font, std::string_view str, const Position &pos = {0, 0, 0}, float scale = 1.0f,
             const Colorf &color = {1.0f, 1.0f, 1.0f});
-        void draw_string(const std::u16string &str, const Position &pos = {0, 0, 0}, float scale = 1.0f,
+        void draw_string(std::u16string_view str, const Position &pos = {0, 0, 0}, float scale = 1.0f,
             const Colorf &color = {1.0f, 1.0f, 1.0f});
+        void draw_string(std::string_view str, const Position &pos = {0, 0, 0}, float scale = 1.0f,
+            const Colorf &color = {1.0f, 1.0f, 1.0f});
+
+        // Samples textures through bindless handles stored in a shader storage buffer (GL_ARB_bindless_texture),
+        // so that batches are never broken by the number of textures. Falls back to texture units when the extension
+        // is unsupported. Must not be called between begin and end, returns whether the mode is enabled
+        bool set_bindless(bool enable = true);
+        inline bool is_bindless() const { return this->bindless; }
 
         inline void set_clear_color(Colorf clear_color) { this->clear_color = clear_color; }
         inline       Colorf &get_clear_color()       { return this->clear_color; }
         inline const Colorf &get_clear_color() const { return this->clear_color; }
 
-        inline       gl::ShaderProgram &get_default_mesh_shader()       { return this->mesh_program; }
-        inline const gl::ShaderProgram &get_default_mesh_shader() const { return this->mesh_program; }
+        inline       gl::ShaderProgram &get_default_mesh_shader()       {
+            return this->bindless ? *this->bindless_program : this->mesh_program;
+        }
+        inline const gl::ShaderProgram &get_default_mesh_shader() const {
+            return this->bindless ? *this->bindless_program : this->mesh_program;
+        }
 
     protected:
         struct Vertex {
             Mesh::Vertex vertex;
             Colorf blend_color;
-            int tex_idx;
+            int tex_idx; // Index in the texture arrays if layer is positive, in the bindless handles with the bindless program
             std::uint8_t mode;
+            int layer = -1;
         };
 
         struct Index {
@@ -140,9 +238,104 @@ class Renderer {
             constexpr inline Index(const Mesh::Index &i): index(i) { }
         };
 
+    public:
+        // Geometry recorded by begin_capture, as ranges of vertices that each use a single texture
+        // Refers to its textures by pointer, so they must outlive it. The glyph atlas pages it uses are kept resident
+        // while it is submitted, but it must be captured again once stale (after a page eviction)
+        class DrawList {
+            friend class Renderer;
+
+            public:
+                inline void clear() {
+                    this->vertices.clear(), this->indices.clear(), this->ranges.clear();
+                    this->textures.clear(), this->texture_arrays.clear(), this->pages.clear();
+                }
+
+                inline bool empty() const { return this->ranges.empty(); }
+                inline bool is_stale() const { return this->epoch != Font::get_eviction_epoch(); }
+                inline std::size_t get_nb_vertices() const { return this->vertices.size(); }
+
+            protected:
+                struct Range {
+                    std::uint32_t first_vertex, nb_vertices;
+                    std::uint32_t first_index,  nb_indices; // Indices are relative to the first vertex
+                    std::uint32_t texture; // Index into textures, or texture_arrays
+                    bool is_array;
+                    bool premultiplied;
+                };
+
+                inline void add_range(std::size_t first_vertex, std::size_t first_index, int texture, bool is_array,
+                        bool premultiplied) {
+                    this->ranges.push_back({(std::uint32_t)first_vertex, (std::uint32_t)(this->vertices.size() - first_vertex),
+                        (std::uint32_t)first_index, (std::uint32_t)(this->indices.size() - first_index),
+                        (std::uint32_t)texture, is_array, premultiplied});
+                }
+
+                template <typename T>
+                static inline int find_or_add(std::vector<T *> &list, T &item) {
+                    auto it = std::find(list.begin(), list.end(), &item);
+                    if (it != list.end())
+                        return it - list.begin();
+                    list.push_back(&item);
+                    return list.size() - 1;
+                }
+
+                inline int get_texture_idx(gl::Texture2d &texture)           { return find_or_add(this->textures, texture); }
+                inline int get_texture_array_idx(gl::Texture2dArray &array)  { return find_or_add(this->texture_arrays, array); }
+
+                inline void add_page(Font *font, std::uint32_t page) {
+                    if (std::find(this->pages.begin(), this->pages.end(), std::pair{font, page}) == this->pages.end())
+                        this->pages.emplace_back(font, page);
+                }
+
+                std::vector<Vertex> vertices;
+                std::vector<Index> indices;
+                std::vector<Range> ranges;
+                std::vector<gl::Texture2d *> textures;
+                std::vector<gl::Texture2dArray *> texture_arrays;
+                std::vector<std::pair<Font *, std::uint32_t>> pages; // Glyph atlas pages, touched on submission
+                std::uint32_t epoch = 0; // Font eviction epoch at capture time
+        };
+
+    protected:
+        // Returns the sampler index of the texture, flushing if all are used
+        // When drawing with the bindless program, returns the index of its handle instead, and never flushes
+        int get_texture_idx(gl::Texture2d &texture);
+        int get_texture_array_idx(gl::Texture2dArray &array);
+
+        // Appends a textured quad without going through a Mesh, vertices in the order given by TextBatch::make_quad
+        void add_quad(gl::Texture2d &texture, const std::array<Mesh::Vertex, 4> &vertices, const Colorf &color,
+            RenderingMode mode = RenderingMode::Default);
+        void add_quad(const ResourceManager::TextureLayer &layer, const std::array<Mesh::Vertex, 4> &vertices,
+            const Colorf &color, RenderingMode mode = RenderingMode::Default);
+        void add_quad_vertices(int tex_idx, int layer, const std::array<Mesh::Vertex, 4> &vertices, const Colorf &color,
+            RenderingMode mode);
+
+        // Glyphs drawn while capturing must have their page recorded, so that it stays resident when replayed
+        inline void record_page(Font *font, std::uint32_t page) {
+            if (this->capture)
+                this->capture->add_page(font, page);
+        }
+
+        // Other programs sample u_textures, even in bindless mode
+        inline bool uses_bindless() const {
+            return this->bindless && (this->cur_program == this->bindless_program);
+        }
+
+        inline std::vector<Vertex> &get_vertex_target() {
+            return this->capture ? this->capture->vertices : this->vertex_buffer;
+        }
+        inline std::vector<Index> &get_index_target() {
+            return this->capture ? this->capture->indices : this->index_buffer;
+        }
+
+        void set_texture_array_units(gl::ShaderProgram &program) const;
+
     protected:
         ResourceManager &resource_man;
         gl::ShaderProgram &mesh_program;
+        gl::ShaderProgram *bindless_program = nullptr; // Loaded the first time bindless mode is enabled
+        bool bindless = false;
 
         gl::VertexArray   vao;
         gl::VertexBuffer  vbo;
@@ -155,9 +348,31 @@ class Renderer {
         std::vector<Vertex>          vertex_buffer;
         std::vector<Index>           index_buffer;
         std::vector<gl::Texture2d *> textures;
+        std::vector<gl::Texture2dArray *> texture_arrays;
+
+        gl::ShaderStorageBuffer           handle_buffer;   // Bound at binding 0 in bindless mode
+        std::vector<GLuint64>             texture_handles;
+        FlatMap<GLuint64, std::uint32_t>  texture_indices; // Index of each handle in texture_handles
+
+        TextLayout text_layout; // Scratch layout for draw_string and measure_string
+
+        DrawList *capture = nullptr;
+
+        struct Target {
+            GLint framebuffer;
+            GLint viewport[4];
+            const glm::mat4 *view_proj;
+            gl::ShaderProgram *program;
+            std::uint8_t mode;
+            DrawList *capture;
+            bool premultiplied;
+        };
+
+        std::vector<Target> targets; // State to restore when popping render targets
 
         gl::ShaderProgram *cur_program = &this->mesh_program;
         std::uint8_t       cur_mode    = GL_TRIANGLES;
+        bool premultiplied = false;
 };
 
 } // namespace cmw
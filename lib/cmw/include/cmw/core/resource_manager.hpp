@@ -18,16 +18,26 @@
 #pragma once
 
 #include <cstdio>
+#include <cstdint>
 #include <cstring>
+#include <future>
 #include <string>
-#include <map>
+#include <string_view>
 #include <vector>
 #include <memory>
+#include <glad/glad.h>
 
+#include "cmw/core/asset_source.hpp"
 #include "cmw/core/text.hpp"
 #include "cmw/core/log.hpp"
 #include "cmw/gl/shader_program.hpp"
 #include "cmw/gl/texture.hpp"
+#include "cmw/gl/texture_container.hpp"
+#include "cmw/utils/file_watcher.hpp"
+#include "cmw/utils/flat_map.hpp"
+#include "cmw/utils/handle_pool.hpp"
+#include "cmw/utils/string_table.hpp"
+#include "cmw/utils/thread_pool.hpp"
 #include "cmw/platform.h"
 
 namespace cmw {
@@ -37,28 +47,154 @@ class ResourceManager {
         // Dummy path for white (empty) texture
         static inline std::string WhiteTexture = "";
 
+        // Directory for generated data (baked fonts, ...), created on demand
+#ifdef CMW_SWITCH
+        static inline std::string CacheDirectory = "sdmc:/cmw-cache/";
+#else
+        static inline std::string CacheDirectory = "cache/";
+#endif
+
+        // Archive mounted once, by the first manager, if present in the asset directory, see the archive make target
+        static inline std::string ArchiveName = "assets.cmwa";
+
+        // Layers allocated per texture array, clamped to the driver limit
+        static inline std::uint32_t TextureArrayLayers = 64;
+
+        using TextureHandle = HandlePool<gl::Texture2d>::Handle;
+        using PathId        = StringTable::Id;
+
+        enum class ResourceType {
+            Texture,
+            GlyphPage,
+            Shader, // Approximated by the size of the program binary, when supported
+        };
+
+        struct MemoryUsage {
+            std::size_t vram = 0, ram = 0;
+            std::size_t nb_resources = 0;
+        };
+
+        // Image stored in a layer of a texture array, see get_texture_layer
+        struct TextureLayer {
+            gl::Texture2dArray *array = nullptr;
+            std::uint32_t layer = 0;
+
+            inline explicit operator bool() const { return this->array != nullptr; }
+        };
+
+        // Zero means unlimited
+        struct MemoryBudget {
+            std::size_t vram = 0, ram = 0;
+        };
+
         ResourceManager();
 
-        gl::Texture2d &get_texture(const std::string &path);
-        gl::ShaderProgram &get_shader(const std::string &vert_path, const std::string &frag_path);
+        // Resources are keyed by interned paths, callers looking up resources every frame should intern their paths
+        // once and use the overloads taking IDs, which never allocate on a hit
+        inline PathId intern_path(std::string_view path) { return this->paths.intern(path); }
+        inline const std::string &get_path(PathId id) const { return this->paths.get(id); }
+
+        // Images are converted on first load to a GPU-ready container (see gl::TextureContainer) stored in the cache
+        // directory, with a mip chain, and block-compressed when the driver supports S3TC. Later loads skip decoding
+        // Assets that already are containers are loaded as-is
+        // Textures returned by reference are pinned, and are never evicted
+        gl::Texture2d &get_texture(PathId path);
+        inline gl::Texture2d &get_texture(std::string_view path) { return get_texture(intern_path(path)); }
+
+        // Returns immediately with a texture that stays white until its image is loaded on the workers,
+        // and uploaded by process_uploads. Errors are logged and leave the texture white
+        gl::Texture2d &get_texture_async(PathId path);
+        inline gl::Texture2d &get_texture_async(std::string_view path) { return get_texture_async(intern_path(path)); }
+
+        // Same as above, but the texture can be evicted by collect once every handle to it is released
+        TextureHandle acquire_texture(PathId path);
+        TextureHandle acquire_texture_async(PathId path);
+        inline TextureHandle acquire_texture(std::string_view path) { return acquire_texture(intern_path(path)); }
+        inline TextureHandle acquire_texture_async(std::string_view path) {
+            return acquire_texture_async(intern_path(path));
+        }
+
+        // Loads the image in a layer of a texture array shared with the images of the same size and format, so that
+        // the renderer can draw hundreds of them without breaking its batch. Meant for many small images of uniform size
+        // (icons, thumbnails, ...). Arrays are allocated TextureArrayLayers at a time, and are never evicted
+        TextureLayer get_texture_layer(PathId path);
+        inline TextureLayer get_texture_layer(std::string_view path) { return get_texture_layer(intern_path(path)); }
+
+        // Uploads decoded textures until budget_ms is exhausted (at least one is uploaded if any is ready)
+        // Must be called from the render thread, once per frame, returns the number of textures uploaded
+        std::size_t process_uploads(float budget_ms = 2.0f);
+        inline std::size_t get_nb_pending_uploads() const { return this->pending_uploads.size(); }
+
+        // Blocks until the program is linked, finishing it if it was requested with get_shader_async
+        // Throws if the program failed to build, whether it was finished here or by process_shaders
+        gl::ShaderProgram &get_shader(PathId vert_path, PathId frag_path);
+        inline gl::ShaderProgram &get_shader(std::string_view vert_path, std::string_view frag_path) {
+            return get_shader(intern_path(vert_path), intern_path(frag_path));
+        }
+
+        // Submits the compiles and the link without checking their status, so that requesting every program
+        // upfront lets the driver work on them in parallel (with GL_KHR_parallel_shader_compile)
+        // The program can be used right away, though the driver will then block until it is linked
+        gl::ShaderProgram &get_shader_async(PathId vert_path, PathId frag_path);
+        inline gl::ShaderProgram &get_shader_async(std::string_view vert_path, std::string_view frag_path) {
+            return get_shader_async(intern_path(vert_path), intern_path(frag_path));
+        }
+
+        // Checks the status of the programs that are done linking, without blocking if the driver supports parallel
+        // compilation (otherwise every program is finished). Errors are logged, returns the number of programs finished
+        std::size_t process_shaders();
+        inline std::size_t get_nb_pending_shaders() const { return this->pending_programs.size(); }
+
+        // Watches the asset directory (Linux only), so that process_reloads can reload the resources whose files change
+        // Mounted archives shadow the asset directory, so only loose assets can be reloaded
+        bool enable_hot_reload(bool enable = true);
+        inline bool is_hot_reload_enabled() const { return this->watcher != nullptr; }
+
+        // Reloads the textures and shader programs whose files changed, in place. Textures are decoded on the workers
+        // and uploaded by process_uploads. Failures are logged and keep the previous version
+        // Must be called from the render thread, once per frame, returns the number of resources reloaded
+        inline std::size_t process_reloads() {
+            return this->watcher ? reload_changed() : 0;
+        }
 
         gl::Texture2d &get_white_texture() const { return *this->white_texture; }
 
+        MemoryUsage get_memory_usage(ResourceType type) const;
+        MemoryUsage get_memory_usage() const; // Total of all types
+
+        inline void set_memory_budget(const MemoryBudget &budget) { this->budget = budget; }
+        inline const MemoryBudget &get_memory_budget() const { return this->budget; }
+
+        // Advances the LRU clock, and if over budget evicts the unreferenced textures and the glyph pages that weren't
+        // used this frame, least recently used first, until usage fits again. Shaders and pinned textures are kept
+        // Must be called once per frame after rendering, returns the number of bytes freed
+        std::size_t collect();
+
         template <typename ...Args>
         inline Font *load_font(Args &&...args) {
             return &*this->fonts.emplace_back(std::make_unique<Font>(std::forward<Args>(args)...));
         }
 
+        // Loads the baked atlas of every font not yet preloaded, or rasterizes its cached range on the worker pool,
+        // uploads the atlases and bakes them for the next run
+        void preload_fonts();
+
         inline std::vector<std::unique_ptr<Font>> &get_fonts() { return this->fonts; }
         inline const std::vector<std::unique_ptr<Font>> &get_fonts() const { return this->fonts; }
 
+        inline ThreadPool &get_workers() { return this->workers; }
+
         // Asset reading helpers
-        static inline FILE *open_asset(const std::string &path, const std::string &mode = "r") {
+        static inline std::string get_asset_path(const std::string &path) {
 #ifdef CMW_SWITCH
-            std::string asset_path = "romfs:/" + path;
+            return "romfs:/" + path;
 #else
-            std::string asset_path = "res/"    + path;
+            return "res/"    + path;
 #endif
+        }
+
+        static inline FILE *open_asset(const std::string &path, const std::string &mode = "r") {
+            std::string asset_path = get_asset_path(path);
             FILE *fp = fopen(asset_path.c_str(), mode.c_str());
             if (!fp)
                 CMW_ERROR("Failed to open %s\n", asset_path.c_str());
@@ -66,27 +202,113 @@ class ResourceManager {
             return fp;
         }
 
+        // Sources are searched from the most recently mounted one, and the asset directory is searched last
+        // Must not be called while assets are being loaded on the workers
+        static inline void mount(std::unique_ptr<AssetSource> source) {
+            asset_sources.push_back(std::move(source));
+        }
+
+        // Memory-mapped on PC, read into a buffer otherwise (romfs can't be mapped)
+        // Prefer this to read_asset, which copies the data
+        static inline AssetView map_asset(const std::string &path) {
+            for (auto it = asset_sources.rbegin(); it != asset_sources.rend(); ++it) {
+                if (auto view = (*it)->open(path); view) {
+                    CMW_TRACE("Mapped %s\n", path.c_str());
+                    return view;
+                }
+            }
+            CMW_ERROR("Failed to open %s\n", path.c_str());
+            return {};
+        }
+
         template <typename T>
         static inline T read_asset(const std::string &path) {
-            FILE *fp = open_asset(path);
-            fseek(fp, 0, SEEK_END);
-            std::size_t size = ftell(fp);
-            fseek(fp, 0, SEEK_SET);
-
-            T container;
-            container.reserve(size);
-            if (fread(container.data(), 1, size, fp) != size)
-                CMW_ERROR("Failed to read %s\n", path.c_str());
-            container[size] = 0; // Ensure null termination
-
-            return container;
+            auto view = map_asset(path);
+            auto *data = reinterpret_cast<const typename T::value_type *>(view.data());
+            return T(data, data + view.size() / sizeof(typename T::value_type));
         }
 
+    private:
+        static inline std::vector<std::unique_ptr<AssetSource>> asset_sources = []() {
+            std::vector<std::unique_ptr<AssetSource>> sources;
+            sources.push_back(std::make_unique<DirectorySource>(get_asset_path("")));
+            return sources;
+        }();
+
+        struct LoadedImage {
+            AssetView data;
+            gl::TextureContainer container; // Points into data, invalid if loading failed
+        };
+
+        struct PendingUpload {
+            PathId path;
+            TextureHandle texture;
+            std::future<LoadedImage> image;
+        };
+
+        struct TextureEntry {
+            TextureHandle handle; // Held by the manager, so unreferenced textures have a use count of 1
+            std::size_t size = 0;
+            bool pinned = false;
+        };
+
+        struct TextureArray {
+            gl::TextureContainer::Format format;
+            std::uint32_t width, height, nb_levels;
+            std::unique_ptr<gl::Texture2dArray> texture;
+            std::uint32_t nb_used = 0;
+        };
+
+        TextureEntry &load_texture(PathId path, bool async);
+        TextureArray &find_texture_array(const gl::TextureContainer &container);
+        void set_texture_size(TextureEntry &entry, std::size_t size);
+
+        static inline std::uint64_t get_program_key(PathId vert_path, PathId frag_path) {
+            return (std::uint64_t)vert_path << 32 | frag_path;
+        }
+
+        // Programs are never destroyed once handed out, a failed link is remembered instead
+        struct ShaderEntry {
+            std::unique_ptr<gl::ShaderProgram> program;
+            bool failed = false;
+        };
+
+        struct PendingProgram {
+            std::uint64_t key;
+            gl::ShaderProgram *program;
+            std::string cache_path; // Empty if binaries are unsupported
+            std::unique_ptr<gl::VertexShader> vert;
+            std::unique_ptr<gl::FragmentShader> frag;
+        };
+
+        bool finish_program(PendingProgram &pending);
+        bool reload_program(std::uint64_t key, gl::ShaderProgram &program);
+        std::size_t reload_changed();
+
+        static std::string get_program_cache_path(const AssetView &vert_src, const AssetView &frag_src);
+
+        // Thread-safe
+        static LoadedImage load_image(const std::string &path, bool compress);
+        static std::vector<std::uint8_t> downsample(const std::vector<std::uint8_t> &src, int width, int height, int nchan);
+
     private:
         gl::Texture2d *white_texture;
         std::vector<std::unique_ptr<Font>> fonts;
-        std::map<std::string, gl::Texture2d> textures;
-        std::map<std::string, gl::ShaderProgram> shader_programs;
+        StringTable paths;
+        HandlePool<gl::Texture2d> texture_pool;
+        FlatMap<PathId, TextureEntry> textures;
+        std::vector<TextureArray> texture_arrays;
+        FlatMap<PathId, TextureLayer> texture_layers;
+        std::size_t textures_vram = 0, shaders_vram = 0;
+        MemoryBudget budget;
+        std::uint64_t frame = 0;
+        FlatMap<std::uint64_t, ShaderEntry> shader_programs; // Keyed by get_program_key
+        std::vector<PendingUpload> pending_uploads;
+        std::vector<PendingProgram> pending_programs;
+        bool compress_textures = false;
+        std::unique_ptr<FileWatcher> watcher; // Null while hot reload is disabled
+        std::vector<std::string> changed_files;
+        ThreadPool workers;
 };
 
 template <typename T>
@@ -98,4 +320,8 @@ inline FILE *open_asset(const std::string &path, const std::string &mode) {
     return ResourceManager::open_asset(path, mode);
 }
 
+inline AssetView map_asset(const std::string &path) {
+    return ResourceManager::map_asset(path);
+}
+
 } // namespace cmw
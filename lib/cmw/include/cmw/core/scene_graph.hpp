@@ -0,0 +1,104 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "cmw/utils.hpp"
+
+namespace cmw {
+
+// Hierarchy of transforms, with the world matrices cached until the local matrix of a node or an ancestor changes
+// Nodes are stored in contiguous arrays ordered so that parents come before their children, which lets update
+// propagate the changes in a single pass. Node ids stay valid until destroyed, their slots in the arrays don't
+class SceneGraph {
+    public:
+        using Node = std::uint32_t;
+        static constexpr Node Invalid = std::numeric_limits<Node>::max();
+
+    public:
+        // Invalid creates a root node
+        Node create(Node parent = Invalid, const glm::mat4 &local = glm::mat4(1.0f));
+
+        // Destroys the descendants of the node as well
+        void destroy(Node node);
+
+        // Moves the node and its subtree under another node, or makes it a root with Invalid
+        void set_parent(Node node, Node parent);
+
+        inline Node get_parent(Node node) const {
+            auto parent = this->parents[get_slot(node)];
+            return (parent != Invalid) ? this->nodes[parent] : Invalid;
+        }
+
+        inline const glm::mat4 &get_local(Node node) const { return this->locals[get_slot(node)]; }
+
+        inline void set_local(Node node, const glm::mat4 &local) {
+            auto slot = get_slot(node);
+            this->locals[slot] = local;
+            this->flags[slot] |= Flags::Dirty;
+        }
+
+        // Only up to date after update
+        inline const glm::mat4 &get_world(Node node) const { return this->worlds[get_slot(node)]; }
+
+        // Whether the world matrix was recomputed by the last update
+        inline bool has_changed(Node node) const { return this->flags[get_slot(node)] & Flags::Changed; }
+
+        // Recomputes the world matrices of the changed nodes and their descendants, returns how many were
+        std::size_t update();
+
+        inline bool contains(Node node) const {
+            return (node < this->slots.size()) && (this->slots[node] != Invalid);
+        }
+
+        inline std::size_t size() const { return this->nodes.size(); }
+
+    protected:
+        enum Flags: std::uint8_t {
+            Dirty   = CMW_BIT(0), // Local matrix or parent changed since the last update
+            Changed = CMW_BIT(1), // World matrix recomputed by the last update
+        };
+
+        inline std::uint32_t get_slot(Node node) const { return this->slots[node]; }
+
+        // Flags the slot and the slots of its descendants in the scratch mask
+        void mark_subtree(std::uint32_t slot);
+
+        // Moves the masked slots to the back, keeping the relative order on both sides, or drops them
+        void partition(bool keep_masked);
+
+    protected:
+        // Indexed by slot
+        std::vector<Node>          nodes;
+        std::vector<std::uint32_t> parents; // Slot of the parent, or Invalid
+        std::vector<glm::mat4>     locals, worlds;
+        std::vector<std::uint8_t>  flags;
+
+        // Indexed by node
+        std::vector<std::uint32_t> slots; // Invalid for destroyed nodes
+        std::vector<Node>          free_nodes;
+
+        std::vector<std::uint8_t>  mask;
+        std::vector<std::uint32_t> remap;
+};
+
+} // namespace cmw
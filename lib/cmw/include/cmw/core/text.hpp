@@ -17,29 +17,55 @@
 
 #pragma once
 
+#include <cstdint>
 #include <unordered_map>
 #include <tuple>
 #include <memory>
+#include <utility>
+#include <string>
+#include <vector>
 #include <stb_truetype.h>
 
 #include "cmw/gl/texture.hpp"
 #include "cmw/utils/color.hpp"
+#include "cmw/utils/mapped_file.hpp"
+#include "cmw/utils/area.hpp"
+#include "cmw/utils/asset_view.hpp"
+#include "cmw/utils/position.hpp"
+#include "cmw/utils/unicode.hpp"
 #include "cmw/platform.h"
 
 namespace cmw {
 
+class TextLayout;
+
 class Glyph {
+    friend class Font;
+
     public:
-        Glyph(stbtt_fontinfo *font_ctx, float scale, int codepoint, int idx, void *data, int width, int height, int off_x, int off_y);
+        Glyph(const stbtt_fontinfo *font_ctx, float scale, int codepoint, int idx);
+        Glyph(int codepoint, int idx, int x1, int y1, int x2, int y2, int advance, int bearing):
+            codepoint(codepoint), idx(idx), x1(x1), y1(y1), x2(x2), y2(y2), advance(advance), bearing(bearing) { }
 
         inline void bind() const {
-            this->texture.bind();
+            this->texture->bind();
         }
 
         inline int get_codepoint() const { return this->codepoint; }
         inline int get_idx()       const { return this->idx; }
 
-        inline gl::Texture2d &get_texture() { return this->texture; }
+        // False once the atlas page holding the glyph was evicted, see Font::use_glyph
+        inline bool is_resident()  const { return this->texture; }
+        inline std::uint32_t get_page() const { return this->page; }
+
+        // Glyphs are stored in atlas pages owned by their font, the uvs delimit the glyph within the page
+        inline gl::Texture2d &get_texture() { return *this->texture; }
+        inline const Position2f &get_uv_min() const { return this->uv_min; }
+        inline const Position2f &get_uv_max() const { return this->uv_max; }
+        inline void set_location(gl::Texture2d *texture, const Position2f &uv_min, const Position2f &uv_max) {
+            this->texture = texture, this->uv_min = uv_min, this->uv_max = uv_max;
+        }
+
         inline int get_width()      const { return this->x2 - this->x1; }
         inline int get_height()     const { return this->y2 - this->y1; }
         inline int get_bitmap_top() const { return this->y1; }
@@ -47,9 +73,10 @@ class Glyph {
         inline int get_bearing()    const { return this->bearing; }
 
     protected:
-        gl::Texture2d texture;
+        gl::Texture2d *texture = nullptr;
+        std::uint32_t page = 0;
+        Position2f uv_min, uv_max;
         int codepoint, idx;
-        int buf_width, buf_height, buf_off_x, buf_off_y;
         int x1, y1, x2, y2;
         int advance, bearing;
 };
@@ -58,21 +85,67 @@ class Font {
     public:
         using Bbox = std::tuple<int, int, int, int>;
 
+        struct RasterizedGlyph {
+            struct Deleter {
+                inline void operator()(unsigned char *bitmap) const { stbtt_FreeBitmap(bitmap, nullptr); }
+            };
+
+            char32_t codepoint;
+            int idx, width, height;
+            std::unique_ptr<unsigned char, Deleter> bitmap;
+        };
+
+        struct PreloadStats {
+            std::size_t nb_glyphs = 0, nb_pages = 0;
+            float rasterize_time = 0.0f, upload_time = 0.0f; // In ms, rasterization time is summed over all workers
+        };
+
+        static constexpr int atlas_width      = 1024;
+        static constexpr int atlas_max_height = 2048;
+        static constexpr int atlas_padding    = 1;
+
 #ifdef CMW_SWITCH
-        Font(PlSharedFontType type, char16_t first_cached = ' ', char16_t last_cached = '~');
+        Font(PlSharedFontType type, char32_t first_cached = ' ', char32_t last_cached = '~');
 #endif
 
-        Font(void *data,              char16_t first_cached = ' ', char16_t last_cached = '~');
-        Font(const std::string &path, char16_t first_cached = ' ', char16_t last_cached = '~');
+        // Glyphs in [first_cached, last_cached] are rasterized by ResourceManager::preload_fonts, others on first use
+        Font(void *data,              char32_t first_cached = ' ', char32_t last_cached = '~');
+        Font(const std::string &path, char32_t first_cached = ' ', char32_t last_cached = '~');
         ~Font();
 
-        inline bool has_glyph(char16_t chr) const {
+        inline bool has_glyph(char32_t chr) const {
             return this->cached_glyphs.count(chr) || stbtt_FindGlyphIndex(&this->font_ctx, chr);
         }
 
-        Glyph &cache_glyph(char16_t chr);
+        Glyph &cache_glyph(char32_t chr);
+
+        Glyph &get_glyph(char32_t chr);
+
+        // Marks the page of a glyph of this font as used, and re-caches the glyph in place if its page was evicted
+        // Must be called for glyphs looked up in a previous frame before drawing them
+        inline Glyph &use_glyph(Glyph &glyph) {
+            if (!glyph.is_resident())
+                return cache_glyph(glyph.get_codepoint());
+            touch_page(glyph.page);
+            return glyph;
+        }
+
+        inline void touch_page(std::uint32_t idx) {
+            this->pages[idx].last_used = this->frame;
+        }
+
+        // Thread-safe, only reads the font data
+        std::vector<RasterizedGlyph> rasterize_range(char32_t first, char32_t last) const;
 
-        Glyph &get_glyph(char16_t chr);
+        // Packs the glyphs into atlas pages and uploads each page once, must be called from the render thread
+        void upload_glyphs(std::vector<RasterizedGlyph> &glyphs);
+
+        inline bool needs_preload() const { return !this->preloaded; }
+        inline char32_t get_first_cached() const { return this->first_cached; }
+        inline char32_t get_last_cached()  const { return this->last_cached; }
+
+        inline       PreloadStats &get_preload_stats()       { return this->preload_stats; }
+        inline const PreloadStats &get_preload_stats() const { return this->preload_stats; }
 
         inline stbtt_fontinfo *get_ctx() { return &this->font_ctx; }
 
@@ -80,22 +153,223 @@ class Font {
         inline int get_descender() const { return this->descender; }
         inline int get_linegap()   const { return this->linegap; }
 
-        inline int get_kerning(int ch1, int ch2) const {
-            return stbtt_GetCodepointKernAdvance(&this->font_ctx, ch1, ch2);
+        // Distance between two consecutive baselines, the descender is negative
+        inline int get_line_height() const { return this->ascender - this->descender + this->linegap; }
+
+        // Scaled the same way as the glyph metrics
+        inline float get_kerning(int ch1, int ch2) const {
+            if (this->baked_kern_pairs && is_cached_range(ch1) && is_cached_range(ch2))
+                return get_baked_kerning(ch1, ch2) * this->font_scale;
+            return stbtt_GetCodepointKernAdvance(&this->font_ctx, ch1, ch2) * this->font_scale;
         }
 
+        // Lays out the string using only this font, glyphs it doesn't have are skipped
+        // A max_width of 0 disables wrapping
+        template <typename Str>
+        void layout(TextLayout &layout, Str str, float scale = 1.0f, float max_width = 0.0f);
+
+        template <typename Str>
+        Area measure(Str str, float scale = 1.0f, float max_width = 0.0f);
+
+        // Baked fonts store the atlas pages, glyph metrics and kerning of the preloaded range
+        // The cache is keyed by the hash of the font data and the font scale
+        std::string get_baked_path(const std::string &cache_dir);
+        bool load_baked(const std::string &path);
+        bool save_baked(const std::string &path);
+        void release_staging();
+
         static constexpr float get_font_scale() { return font_scale; }
 
+        // Atlas pages memory accounting and eviction, driven by ResourceManager::collect
+        inline void set_frame(std::uint64_t frame) { this->frame = frame; }
+        inline std::size_t get_nb_pages() const { return this->pages.size(); }
+        inline bool is_page_resident(std::size_t idx)         const { return this->pages[idx].texture != nullptr; }
+        inline std::uint64_t get_page_last_used(std::size_t idx) const { return this->pages[idx].last_used; }
+        inline std::size_t get_page_vram(std::size_t idx) const {
+            return is_page_resident(idx) ? (std::size_t)this->pages[idx].width * this->pages[idx].height : 0;
+        }
+        inline std::size_t get_page_ram(std::size_t idx) const { return this->pages[idx].staging.capacity(); }
+        std::size_t get_nb_resident_pages() const;
+        std::size_t get_vram_usage() const;
+        std::size_t get_ram_usage() const;
+
+        // Deletes the texture of a page, its glyphs are kept with no location until they are used again
+        // Returns the number of bytes freed
+        std::size_t evict_page(std::size_t idx);
+
+        // Incremented whenever a page of any font is evicted, so that users holding glyph quads can detect it
+        static inline std::uint32_t get_eviction_epoch() { return eviction_epoch; }
+
+    protected:
+        struct AtlasPage {
+            std::unique_ptr<gl::Texture2d> texture;
+            int width, height;
+            int cursor_x = 0, cursor_y = 0, shelf_height = 0; // Shelf packer state
+            std::vector<std::uint8_t> staging;                // Kept until the font is baked
+            std::uint64_t last_used = 0;
+
+            bool allocate(int w, int h, int &x, int &y);
+        };
+
+        struct BakedHeader {
+            std::uint32_t magic, version;
+            std::uint64_t font_hash;
+            float scale;
+            std::int32_t ascender, descender, linegap;
+            std::uint32_t first_cached, last_cached;
+            std::uint32_t nb_pages, nb_glyphs, nb_kern_pairs;
+            std::uint32_t has_kerning;
+        };
+
+        struct BakedPage {
+            std::uint32_t width, height;
+            std::uint64_t offset;
+            std::int32_t cursor_x, cursor_y, shelf_height, reserved;
+        };
+
+        struct BakedGlyph {
+            std::uint32_t codepoint, page;
+            std::int32_t idx, x, y;
+            std::int32_t x1, y1, x2, y2;
+            std::int32_t advance, bearing;
+        };
+
+        struct BakedKernPair {
+            std::uint32_t first, second;
+            std::int32_t advance;
+        };
+
+        static constexpr std::uint32_t baked_magic   = 0x46574d43; // "CMWF"
+        static constexpr std::uint32_t baked_version = 1;
+        static constexpr std::size_t   baked_max_kerning_glyphs = 512; // Pairs are computed in O(n^2)
+
+        AtlasPage &create_page(int width, int height, void *data = nullptr);
+
+        inline bool is_cached_range(char32_t chr) const {
+            return (chr >= this->first_cached) && (chr <= this->last_cached);
+        }
+
+        int get_baked_kerning(int ch1, int ch2) const;
+
     protected:
         static constexpr float font_scale = 0.105f;
+        static inline std::uint32_t eviction_epoch = 0;
 
-        std::vector<std::uint8_t> data;
+        AssetView file; // stb_truetype reads the font directly from the mapping
+        const std::uint8_t *font_data_ptr = nullptr;
+        std::size_t font_data_size = 0;
+        std::uint64_t font_hash = 0;
+        MappedFile baked;
+        const BakedKernPair *baked_kern_pairs = nullptr;
+        std::size_t nb_baked_kern_pairs = 0;
         stbtt_fontinfo font_ctx;
         int ascender, descender, linegap;
-        std::unordered_map<char16_t, Glyph> cached_glyphs;
+        char32_t first_cached, last_cached;
+        bool preloaded = false;
+        PreloadStats preload_stats;
+        std::vector<AtlasPage> pages; // Evicted pages are kept with no texture, so that glyphs can refer to them by index
+        std::uint64_t frame = 0;
+        std::unordered_map<char32_t, Glyph> cached_glyphs;
 #ifdef CMW_SWITCH
         PlFontData font_data{};
 #endif
 };
 
+// Glyph positions of a string, computed without emitting geometry so text can be measured and wrapped cheaply
+// Positions are pen positions relative to the baseline of the first line, already scaled, with y going up
+// Buffers are reused between builds, so keeping a layout around avoids allocations
+class TextLayout {
+    public:
+        struct PlacedGlyph {
+            Glyph *glyph;
+            Font *font;
+            Position2f pos;
+            std::uint32_t line;
+        };
+
+        // Consecutive glyphs on the same line using the same font
+        struct GlyphRun {
+            Font *font;
+            std::uint32_t line;
+            std::size_t first, count;
+        };
+
+        struct Line {
+            std::size_t first = 0, count = 0; // Glyph range
+            float baseline = 0.0f, width = 0.0f;
+            float ascender = 0.0f, descender = 0.0f, linegap = 0.0f;
+        };
+
+    public:
+        // Glyphs are taken from font preferentially, and from fallback(chr) otherwise (which can return nullptr)
+        // Lines are broken on '\n', and after the last space preceding a glyph that would exceed max_width
+        // If there is no such space, the line is broken before the glyph instead
+        template <typename Str, typename F>
+        void build(Font *font, Str str, F &&fallback, float scale = 1.0f, float max_width = 0.0f) {
+            build_with(font, str, [&](char32_t chr) -> std::pair<Font *, Glyph *> {
+                Font *cur_font = font;
+                if ((!cur_font || !cur_font->has_glyph(chr)) && !(cur_font = fallback(chr)))
+                    return {nullptr, nullptr};
+                return {cur_font, &cur_font->get_glyph(chr)};
+            }, scale, max_width);
+        }
+
+        // resolve(chr) returns the font and glyph to use for a codepoint, or nullptrs to skip it
+        // Layout itself only reads font metrics, so this is thread-safe if resolve is
+        template <typename Str, typename F>
+        void build_with(Font *font, Str str, F &&resolve, float scale = 1.0f, float max_width = 0.0f) {
+            begin(font, scale);
+            unicode::for_each_codepoint(str, [&](char32_t chr) {
+                if (chr == U'\n')
+                    return new_line();
+                if (auto [cur_font, glyph] = resolve(chr); glyph)
+                    place_glyph(*cur_font, *glyph, scale, max_width);
+            });
+            finish();
+        }
+
+        void clear();
+
+        inline const std::vector<PlacedGlyph> &get_glyphs() const { return this->glyphs; }
+        inline const std::vector<GlyphRun>    &get_runs()   const { return this->runs; }
+        inline const std::vector<Line>        &get_lines()  const { return this->lines; }
+
+        // Bounding box of all lines, from the top of the first one to the bottom of the last one
+        inline float get_width()  const { return this->width; }
+        inline float get_height() const { return this->height; }
+        inline Area  get_size()   const { return Area(this->width, this->height); }
+        inline float get_scale()  const { return this->scale; }
+
+    protected:
+        void begin(Font *font, float scale);
+        void new_line();
+        void place_glyph(Font &font, Glyph &glyph, float scale, float max_width);
+        void finish();
+
+    protected:
+        std::vector<PlacedGlyph> glyphs;
+        std::vector<GlyphRun>    runs;
+        std::vector<Line>        lines;
+        float width = 0.0f, height = 0.0f, scale = 1.0f;
+
+        // Build state
+        Font *default_font = nullptr, *last_font = nullptr;
+        char32_t last_codepoint = 0;
+        float pen_x = 0.0f;
+        std::size_t line_first = 0, break_glyph = 0; // First glyph of the line, first glyph after the last space
+        float break_x = 0.0f, break_width = 0.0f;    // Pen position after the last space, line width before it
+};
+
+template <typename Str>
+void Font::layout(TextLayout &layout, Str str, float scale, float max_width) {
+    layout.build(this, str, [](char32_t) -> Font * { return nullptr; }, scale, max_width);
+}
+
+template <typename Str>
+Area Font::measure(Str str, float scale, float max_width) {
+    TextLayout layout;
+    this->layout(layout, str, scale, max_width);
+    return layout.get_size();
+}
+
 } // namespace cmw
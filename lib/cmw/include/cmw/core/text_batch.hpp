@@ -0,0 +1,172 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <array>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "cmw/core/mesh.hpp"
+#include "cmw/core/text.hpp"
+#include "cmw/gl/texture.hpp"
+#include "cmw/utils/color.hpp"
+#include "cmw/utils/position.hpp"
+
+namespace cmw {
+
+// Collects many strings to lay them out and generate their quads in one pass
+// Glyph lookups are shared by the whole batch and kept across clear(), so a batch rebuilt every frame with similar
+// contents (eg. a table of numbers) only resolves each codepoint once
+// Once built, a batch can be submitted any number of times until it is modified, or until an atlas page is evicted
+class TextBatch {
+    public:
+        struct Quad {
+            gl::Texture2d *texture;
+            std::array<Mesh::Vertex, 4> vertices;
+            Colorf color;
+        };
+
+    public:
+        TextBatch() = default;
+
+        // pos is the pen position of the first line, as with Renderer::draw_string
+        void add(std::u16string_view str, const Position &pos = {0, 0, 0}, float scale = 1.0f,
+            const Colorf &color = {1.0f, 1.0f, 1.0f}, Font *font = nullptr, float max_width = 0.0f);
+        void add(std::string_view str, const Position &pos = {0, 0, 0}, float scale = 1.0f,
+            const Colorf &color = {1.0f, 1.0f, 1.0f}, Font *font = nullptr, float max_width = 0.0f);
+
+        // Removes the entries but keeps the resolved glyphs
+        void clear();
+        // Also forgets the resolved glyphs, needed if a font is destroyed
+        void reset();
+
+        // Looks up the glyphs of the codepoints added since the last call, with the same semantics as TextLayout::build
+        // Must be called from the render thread, as missing glyphs get rasterized and uploaded
+        template <typename F>
+        void resolve(F &&fallback) {
+            if (this->resolved_epoch != Font::get_eviction_epoch()) {
+                for_each_resolved([](Resolved &resolved) {
+                    if (resolved.glyph && !resolved.glyph->is_resident())
+                        resolved.font->use_glyph(*resolved.glyph);
+                });
+                this->resolved_epoch = Font::get_eviction_epoch();
+            }
+
+            for (auto key: this->pending) {
+                auto chr = (char32_t)key;
+                auto &resolved = lookup(key >> 32, chr);
+                Font *font = this->fonts[key >> 32];
+                if ((!font || !font->has_glyph(chr)) && !(font = fallback(chr)))
+                    continue;
+                resolved.font = font, resolved.glyph = &font->get_glyph(chr);
+            }
+            this->pending.clear();
+        }
+
+        // Lays out every entry and generates the quads, thread-safe once resolved
+        void build();
+
+        inline bool is_resolved() const {
+            return this->pending.empty() && (this->resolved_epoch == Font::get_eviction_epoch());
+        }
+        inline bool is_built() const { return this->built && (this->built_epoch == Font::get_eviction_epoch()); }
+        inline std::size_t size() const { return this->entries.size(); }
+
+        inline const std::vector<Quad> &get_quads() const { return this->quads; }
+
+        // Atlas pages referenced by the quads, to be marked as used when submitting them
+        inline const std::vector<std::pair<Font *, std::uint32_t>> &get_pages() const { return this->pages; }
+
+        // Vertices of a glyph drawn at the pen position pos, in the order top-left, top-right, bottom-right, bottom-left
+        static inline std::array<Mesh::Vertex, 4> make_quad(const Glyph &glyph, const Position &pos, float scale) {
+            float chr_w = (float)glyph.get_width() * scale, chr_h = (float)glyph.get_height() * scale;
+            float chr_x = pos.x + glyph.get_bearing() * scale;
+            float chr_y = pos.y - chr_h - glyph.get_bitmap_top() * scale;
+
+            const auto &uv_min = glyph.get_uv_min(), &uv_max = glyph.get_uv_max();
+            return {{
+                { {chr_x,         chr_y + chr_h, pos.z}, {uv_min.x, uv_min.y} },
+                { {chr_x + chr_w, chr_y + chr_h, pos.z}, {uv_max.x, uv_min.y} },
+                { {chr_x + chr_w, chr_y,         pos.z}, {uv_max.x, uv_max.y} },
+                { {chr_x,         chr_y,         pos.z}, {uv_min.x, uv_max.y} },
+            }};
+        }
+
+    protected:
+        struct Entry {
+            std::size_t first, count; // Codepoint range
+            Position pos;
+            float scale;
+            Colorf color;
+            std::uint32_t font_idx;
+            float max_width;
+        };
+
+        struct Resolved {
+            Font  *font  = nullptr;
+            Glyph *glyph = nullptr;
+            bool   known = false; // Queued for resolution, glyph stays null if no font has it
+        };
+
+        using AsciiTable = std::array<Resolved, 0x80>;
+
+        template <typename Str>
+        void add_impl(Str str, const Position &pos, float scale, const Colorf &color, Font *font, float max_width);
+
+        std::uint32_t get_font_idx(Font *font);
+
+        inline Resolved &lookup(std::uint32_t font_idx, char32_t chr) {
+            if (chr < 0x80)
+                return this->ascii[font_idx][chr];
+            return this->resolved[(std::uint64_t)font_idx << 32 | chr];
+        }
+
+        template <typename F>
+        inline void for_each_resolved(F &&f) {
+            for (auto &table: this->ascii)
+                for (auto &resolved: table)
+                    f(resolved);
+            for (auto &[key, resolved]: this->resolved)
+                f(resolved);
+        }
+
+        inline const Resolved *find(std::uint32_t font_idx, char32_t chr) const {
+            if (chr < 0x80)
+                return &this->ascii[font_idx][chr];
+            auto it = this->resolved.find((std::uint64_t)font_idx << 32 | chr);
+            return (it != this->resolved.end()) ? &it->second : nullptr;
+        }
+
+    protected:
+        std::vector<char32_t> codepoints;
+        std::vector<Entry>    entries;
+        std::vector<Quad>     quads;
+        std::vector<std::pair<Font *, std::uint32_t>> pages;
+        TextLayout            layout;
+        bool built = false;
+        std::uint32_t built_epoch = 0, resolved_epoch = 0;
+
+        std::vector<Font *>     fonts = {nullptr}; // Distinct preferred fonts, indexed by Entry::font_idx
+        std::vector<AsciiTable> ascii = {AsciiTable{}};
+        std::unordered_map<std::uint64_t, Resolved> resolved;
+        std::vector<std::uint64_t> pending;
+};
+
+} // namespace cmw
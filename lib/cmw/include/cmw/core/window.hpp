@@ -70,11 +70,13 @@ class Window {
             glfwSwapBuffers(get_window());
         }
 
-        void update() const {
+        // Input callbacks are run here, after polling
+        void update() {
             poll_events();
 #ifdef CMW_SWITCH
             this->input_manager.process_nx_events(get_window());
 #endif
+            this->input_manager.process_events();
             swap_buffers();
         }
 
@@ -102,8 +104,8 @@ class Window {
         inline       input::InputManager &get_input_manager()       { return this->input_manager; }
         inline const input::InputManager &get_input_manager() const { return this->input_manager; }
 
-        template <typename T> std::size_t register_callback(input::InputManager::Callback<T> cb) {
-            return get_input_manager().register_callback<T>(cb);
+        template <typename T, typename F> std::size_t register_callback(F &&cb) {
+            return get_input_manager().register_callback<T>(std::forward<F>(cb));
         }
 
         template <typename T> void remove_callback(std::size_t handle) {
@@ -18,8 +18,11 @@
 #pragma once
 
 #include "cmw/gl/buffer.hpp"
+#include "cmw/gl/extensions.hpp"
+#include "cmw/gl/framebuffer.hpp"
 #include "cmw/gl/object.hpp"
 #include "cmw/gl/shader.hpp"
 #include "cmw/gl/shader_program.hpp"
 #include "cmw/gl/texture.hpp"
+#include "cmw/gl/texture_container.hpp"
 #include "cmw/gl/vertex_array.hpp"
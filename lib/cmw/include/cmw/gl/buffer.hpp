@@ -168,9 +168,18 @@ class VertexBufferN: public BufferN<GL_ARRAY_BUFFER, N> {
 template <std::size_t N = 1>
 class ElementBufferN: public BufferN<GL_ELEMENT_ARRAY_BUFFER, N> { };
 
+template <std::size_t N = 1>
+class ShaderStorageBufferN: public BufferN<GL_SHADER_STORAGE_BUFFER, N> {
+    public:
+        inline void bind_base(GLuint binding) const {
+            glBindBufferBase(this->get_type(), binding, this->get_handle());
+        }
+};
+
 template <GLenum Type>
-using Buffer        = BufferN<Type, 1>;
-using VertexBuffer  = VertexBufferN<1>;
-using ElementBuffer = ElementBufferN<1>;
+using Buffer              = BufferN<Type, 1>;
+using VertexBuffer        = VertexBufferN<1>;
+using ElementBuffer       = ElementBufferN<1>;
+using ShaderStorageBuffer = ShaderStorageBufferN<1>;
 
 } // namespace cmw::gl
@@ -0,0 +1,93 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <glad/glad.h>
+
+namespace cmw::gl {
+
+// Extensions aren't loaded by glad, so their enums are defined here
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#   define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83f0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#   define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83f3
+#endif
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#   define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91b0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#   define GL_COMPLETION_STATUS_KHR         0x91b1
+#endif
+
+// Must be called with a current context, the list is queried once
+static inline bool has_extension(std::string_view name) {
+    static std::vector<std::string> extensions = []() {
+        GLint nb = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &nb);
+        std::vector<std::string> exts;
+        exts.reserve(nb);
+        for (GLint i = 0; i < nb; ++i)
+            exts.emplace_back(reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i)));
+        return exts;
+    }();
+    return std::find(extensions.begin(), extensions.end(), name) != extensions.end();
+}
+
+// Extension entry points, null when the extension is unsupported
+namespace ext {
+
+using PFNGLMAXSHADERCOMPILERTHREADSPROC = void (APIENTRYP)(GLuint count);
+inline PFNGLMAXSHADERCOMPILERTHREADSPROC MaxShaderCompilerThreads = nullptr;
+
+inline bool parallel_shader_compile = false;
+
+using PFNGLGETTEXTUREHANDLEPROC             = GLuint64 (APIENTRYP)(GLuint texture);
+using PFNGLMAKETEXTUREHANDLERESIDENTPROC    = void (APIENTRYP)(GLuint64 handle);
+using PFNGLMAKETEXTUREHANDLENONRESIDENTPROC = void (APIENTRYP)(GLuint64 handle);
+inline PFNGLGETTEXTUREHANDLEPROC             GetTextureHandle             = nullptr;
+inline PFNGLMAKETEXTUREHANDLERESIDENTPROC    MakeTextureHandleResident    = nullptr;
+inline PFNGLMAKETEXTUREHANDLENONRESIDENTPROC MakeTextureHandleNonResident = nullptr;
+
+inline bool bindless_texture = false;
+
+} // namespace ext
+
+// Called once glad is initialized, with the same loader
+static inline void load_extensions(GLADloadproc load) {
+    // The ARB version is identical, and is exposed by some drivers instead of the KHR one
+    if (has_extension("GL_KHR_parallel_shader_compile"))
+        ext::MaxShaderCompilerThreads = (ext::PFNGLMAXSHADERCOMPILERTHREADSPROC)load("glMaxShaderCompilerThreadsKHR");
+    else if (has_extension("GL_ARB_parallel_shader_compile"))
+        ext::MaxShaderCompilerThreads = (ext::PFNGLMAXSHADERCOMPILERTHREADSPROC)load("glMaxShaderCompilerThreadsARB");
+    ext::parallel_shader_compile = ext::MaxShaderCompilerThreads != nullptr;
+
+    if (has_extension("GL_ARB_bindless_texture")) {
+        ext::GetTextureHandle             = (ext::PFNGLGETTEXTUREHANDLEPROC)load("glGetTextureHandleARB");
+        ext::MakeTextureHandleResident    = (ext::PFNGLMAKETEXTUREHANDLERESIDENTPROC)load("glMakeTextureHandleResidentARB");
+        ext::MakeTextureHandleNonResident = (ext::PFNGLMAKETEXTUREHANDLENONRESIDENTPROC)load("glMakeTextureHandleNonResidentARB");
+    }
+    ext::bindless_texture = ext::GetTextureHandle && ext::MakeTextureHandleResident && ext::MakeTextureHandleNonResident;
+}
+
+} // namespace cmw::gl
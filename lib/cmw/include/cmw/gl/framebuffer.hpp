@@ -0,0 +1,81 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <stdexcept>
+#include <glad/glad.h>
+
+#include "cmw/core/log.hpp"
+#include "cmw/gl/object.hpp"
+#include "cmw/utils.hpp"
+
+namespace cmw::gl {
+
+// Not bound on creation, since that would redirect the draws that follow
+template <std::size_t N = 1>
+class FramebufferN: public GlObject {
+    public:
+        inline FramebufferN() {
+            CMW_TRACE("Creating framebuffer object\n");
+            glGenFramebuffers(get_nb(), &this->handle);
+            CMW_TRY_THROW(get_handle(), std::runtime_error("Could not create framebuffer object"));
+        }
+
+        inline ~FramebufferN() {
+            CMW_TRACE("Destructing framebuffer object\n");
+            glDeleteFramebuffers(get_nb(), &this->handle);
+        }
+
+        // The framebuffer must be bound, and attachments must be set again when the texture object is recreated
+        template <typename T>
+        static inline void attach(const T &texture, GLenum attachment = GL_COLOR_ATTACHMENT0, GLint mipmap_lvl = 0) {
+            glFramebufferTexture(GL_FRAMEBUFFER, attachment, texture.get_handle(), mipmap_lvl);
+        }
+
+        static inline GLenum get_status() {
+            return glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        }
+
+        static inline bool is_complete() {
+            return get_status() == GL_FRAMEBUFFER_COMPLETE;
+        }
+
+        inline void bind() const {
+            glBindFramebuffer(GL_FRAMEBUFFER, get_handle());
+        }
+
+        static inline void bind(GLuint handle) {
+            glBindFramebuffer(GL_FRAMEBUFFER, handle);
+        }
+
+        static inline void unbind() {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+
+        static inline GLuint get_bound() {
+            GLint handle;
+            glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &handle);
+            return handle;
+        }
+
+        static constexpr inline std::size_t get_nb() { return N; }
+};
+
+using Framebuffer = FramebufferN<1>;
+
+} // namespace cmw::gl
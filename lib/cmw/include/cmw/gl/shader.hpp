@@ -19,12 +19,14 @@
 
 #include <cstdio>
 #include <string>
+#include <string_view>
 #include <iostream>
 #include <stdexcept>
 #include <glad/glad.h>
 
 #include "cmw/core/log.hpp"
 #include "cmw/gl/object.hpp"
+#include "cmw/utils/asset_view.hpp"
 #include "cmw/utils.hpp"
 
 namespace cmw::gl {
@@ -38,7 +40,21 @@ class Shader: public GlObject {
         }
 
         inline Shader(const std::string &path): Shader() {
-            auto src = read_asset<std::string>(path);
+            load_source(map_asset(path).str());
+        }
+
+        inline ~Shader() {
+            CMW_TRACE("Destructing shader object\n");
+            glDeleteShader(get_handle());
+        }
+
+        inline void set_source(std::string_view src) const {
+            const char *dat = src.data();
+            GLint len = src.size();
+            glShaderSource(get_handle(), 1, &dat, &len);
+        }
+
+        inline void load_source(std::string_view src) const {
             set_source(src);
             if (!compile()) {
                 print_log();
@@ -46,19 +62,19 @@ class Shader: public GlObject {
             }
         }
 
-        inline ~Shader() {
-            CMW_TRACE("Destructing shader object\n");
-            glDeleteShader(get_handle());
+        inline GLint compile() const {
+            begin_compile();
+            return is_compiled();
         }
 
-        inline void set_source(const std::string &src) const {
-            const char *dat = src.c_str();
-            glShaderSource(get_handle(), 1, &dat, NULL);
+        // Doesn't query the status, so the driver is free to compile in the background
+        inline void begin_compile() const {
+            glCompileShader(get_handle());
         }
 
-        inline GLint compile() const {
+        // Blocks until compilation is done
+        inline GLint is_compiled() const {
             GLint rc;
-            glCompileShader(get_handle());
             glGetShaderiv(get_handle(), GL_COMPILE_STATUS, &rc);
             return rc;
         }
@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include <cstdint>
+#include <cstdio>
 #include <string>
 #include <iostream>
 #include <algorithm>
@@ -25,12 +27,16 @@
 #include <utility>
 #include <stdexcept>
 #include <map>
+#include <vector>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "cmw/gl/extensions.hpp"
 #include "cmw/gl/object.hpp"
 #include "cmw/gl/shader.hpp"
+#include "cmw/utils/hash.hpp"
+#include "cmw/utils/mapped_file.hpp"
 #include "cmw/utils/position.hpp"
 
 namespace cmw::gl {
@@ -44,12 +50,7 @@ class ShaderProgram: public GlObject {
 
         template <typename ...Shaders>
         inline ShaderProgram(Shaders &&...shaders): ShaderProgram() {
-            attach_shaders(std::forward<Shaders>(shaders)...);
-            if (!link()) {
-                print_log();
-                throw std::runtime_error("Could not link shader program");
-            }
-            detach_shaders(std::forward<Shaders>(shaders)...);
+            link_shaders(std::forward<Shaders>(shaders)...);
         }
 
         inline ~ShaderProgram() {
@@ -67,14 +68,152 @@ class ShaderProgram: public GlObject {
             (glDetachShader(get_handle(), shaders.get_handle()), ...);
         }
 
-        inline GLint link() const {
-            GLint rc;
+        inline GLint link() {
+            begin_link();
+            return is_linked();
+        }
+
+        // Doesn't query the status, so the driver is free to link in the background
+        inline void begin_link() {
             glLinkProgram(get_handle());
+            this->uniform_loc_cache.clear();
+        }
+
+        // Blocks until linking is done
+        inline GLint is_linked() const {
+            GLint rc;
             glGetProgramiv(get_handle(), GL_LINK_STATUS, &rc);
-            if (rc); // TODO: delete shaders
             return rc;
         }
 
+        // Never blocks with parallel shader compilation, otherwise always returns true
+        inline bool is_complete() const {
+            if (!ext::parallel_shader_compile)
+                return true;
+            GLint rc;
+            glGetProgramiv(get_handle(), GL_COMPLETION_STATUS_KHR, &rc);
+            return rc;
+        }
+
+        template <typename ...Shaders>
+        inline void link_shaders(Shaders &&...shaders) {
+            attach_shaders(std::forward<Shaders>(shaders)...);
+            if (!link()) {
+                print_log();
+                throw std::runtime_error("Could not link shader program");
+            }
+            detach_shaders(std::forward<Shaders>(shaders)...);
+        }
+
+        // Exchanges the underlying program objects, so that a program can be replaced while references to it are held
+        inline void swap(ShaderProgram &other) {
+            std::swap(this->handle, other.handle);
+            this->uniform_loc_cache.clear();
+            other.uniform_loc_cache.clear();
+        }
+
+        // Sets the uniforms of this program to the values they have in another, matching them by name
+        // Only non-block uniforms of scalar, vector, matrix and sampler types are copied
+        inline void copy_uniforms(const ShaderProgram &from) {
+            GLint nb_uniforms = 0;
+            glGetProgramiv(from.get_handle(), GL_ACTIVE_UNIFORMS, &nb_uniforms);
+            for (GLint i = 0; i < nb_uniforms; ++i) {
+                char name[0x100];
+                GLint size;
+                GLenum type;
+                glGetActiveUniform(from.get_handle(), i, sizeof(name), nullptr, &size, &type, name);
+
+                // Arrays are reported by their first element, and each element has its own location
+                std::string base = name;
+                if (auto pos = base.find('['); pos != std::string::npos)
+                    base.resize(pos);
+                for (GLint j = 0; j < size; ++j) {
+                    auto elem = (size > 1) ? base + '[' + std::to_string(j) + ']' : base;
+                    GLint src = glGetUniformLocation(from.get_handle(), elem.c_str());
+                    GLint dst = glGetUniformLocation(get_handle(), elem.c_str());
+                    if ((src >= 0) && (dst >= 0))
+                        copy_uniform(from, src, dst, type);
+                }
+            }
+        }
+
+        // Must be called before linking for the driver to keep the binary around
+        inline void set_binary_retrievable() const {
+            glProgramParameteri(get_handle(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+
+        // Binaries are only valid for the driver that produced them, the caller is expected to key the path on
+        // the shader sources and get_driver_hash. Returns false if the file is missing or invalid, or if the driver
+        // rejects it, in which case the program can still be linked from source
+        inline bool load_binary(const std::string &path) {
+            MappedFile file;
+            if (!file.open(path))
+                return false;
+
+            auto *header = reinterpret_cast<const BinaryHeader *>(file.data());
+            if ((file.size() < sizeof(BinaryHeader)) || (header->magic != binary_magic)
+                    || (header->driver_hash != get_driver_hash()) || (sizeof(BinaryHeader) + header->size > file.size())) {
+                CMW_WARN("Ignoring program binary %s: bad header\n", path.c_str());
+                return false;
+            }
+
+            GLint rc;
+            glProgramBinary(get_handle(), header->format, header + 1, header->size);
+            glGetProgramiv(get_handle(), GL_LINK_STATUS, &rc);
+            if (!rc) {
+                CMW_WARN("Driver rejected program binary %s\n", path.c_str());
+                std::remove(path.c_str());
+                return false;
+            }
+            this->uniform_loc_cache.clear();
+            return true;
+        }
+
+        inline std::size_t get_binary_size() const {
+            GLint size = 0;
+            glGetProgramiv(get_handle(), GL_PROGRAM_BINARY_LENGTH, &size);
+            return std::max(size, 0);
+        }
+
+        inline bool save_binary(const std::string &path) const {
+            GLint size = get_binary_size();
+            if (size <= 0)
+                return false;
+
+            std::vector<std::uint8_t> data(sizeof(BinaryHeader) + size);
+            auto *header = reinterpret_cast<BinaryHeader *>(data.data());
+            GLenum format;
+            glGetProgramBinary(get_handle(), size, &size, &format, header + 1);
+            *header = { binary_magic, format, get_driver_hash(), (std::uint64_t)size };
+
+            std::string tmp_path = path + ".tmp";
+            FILE *fp = std::fopen(tmp_path.c_str(), "wb");
+            if (!fp)
+                return false;
+            bool ok = std::fwrite(data.data(), 1, sizeof(BinaryHeader) + size, fp) == sizeof(BinaryHeader) + size;
+            ok &= !std::fclose(fp);
+            if (!ok || std::rename(tmp_path.c_str(), path.c_str())) {
+                std::remove(tmp_path.c_str());
+                return false;
+            }
+            return true;
+        }
+
+        static inline bool has_binary_support() {
+            GLint nb_formats = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nb_formats);
+            return nb_formats > 0;
+        }
+
+        // Identifies the driver build, binaries are invalidated when any of these change
+        static inline std::uint64_t get_driver_hash() {
+            std::uint64_t hash = fnv1a_basis;
+            for (GLenum name: {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION})
+                if (auto *str = reinterpret_cast<const char *>(glGetString(name)); str)
+                    hash = fnv1a(std::string_view(str), hash);
+            return hash;
+        }
+
         inline void use() const {
             glUseProgram(get_handle());
         }
@@ -148,6 +287,52 @@ class ShaderProgram: public GlObject {
         }
 
     private:
+        inline void copy_uniform(const ShaderProgram &from, GLint src, GLint dst, GLenum type) const {
+            auto copy_f = [&](auto &&set) {
+                GLfloat val[16];
+                glGetUniformfv(from.get_handle(), src, val);
+                set(get_handle(), dst, 1, val);
+            };
+            auto copy_i = [&](auto &&set) {
+                GLint val[4];
+                glGetUniformiv(from.get_handle(), src, val);
+                set(get_handle(), dst, 1, val);
+            };
+            auto mat = [](auto &&set) {
+                return [set](GLuint program, GLint loc, GLsizei count, const GLfloat *val) {
+                    set(program, loc, count, GL_FALSE, val);
+                };
+            };
+
+            switch (type) {
+                case GL_FLOAT:      return copy_f(glProgramUniform1fv);
+                case GL_FLOAT_VEC2: return copy_f(glProgramUniform2fv);
+                case GL_FLOAT_VEC3: return copy_f(glProgramUniform3fv);
+                case GL_FLOAT_VEC4: return copy_f(glProgramUniform4fv);
+                case GL_FLOAT_MAT2: return copy_f(mat(glProgramUniformMatrix2fv));
+                case GL_FLOAT_MAT3: return copy_f(mat(glProgramUniformMatrix3fv));
+                case GL_FLOAT_MAT4: return copy_f(mat(glProgramUniformMatrix4fv));
+                case GL_INT_VEC2:   case GL_BOOL_VEC2: return copy_i(glProgramUniform2iv);
+                case GL_INT_VEC3:   case GL_BOOL_VEC3: return copy_i(glProgramUniform3iv);
+                case GL_INT_VEC4:   case GL_BOOL_VEC4: return copy_i(glProgramUniform4iv);
+                case GL_INT:        case GL_BOOL:
+                case GL_SAMPLER_1D: case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE:
+                case GL_SAMPLER_2D_ARRAY: case GL_SAMPLER_2D_SHADOW:
+                    return copy_i(glProgramUniform1iv);
+                default:
+                    CMW_WARN("Not copying uniform of unsupported type %#x\n", type);
+            }
+        }
+
+        struct BinaryHeader {
+            std::uint32_t magic;
+            GLenum        format;
+            std::uint64_t driver_hash;
+            std::uint64_t size;
+        };
+
+        constexpr static std::uint32_t binary_magic = 0x50574d43; // "CMWP"
+
         struct Comp {
             inline bool operator()(const std::string &s1, const std::string &s2) const {
                 return std::strcmp(s1.c_str(), s2.c_str()) < 0;
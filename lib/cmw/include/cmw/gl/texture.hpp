@@ -24,7 +24,10 @@
 #include <stb_image.h>
 
 #include "cmw/core/log.hpp"
+#include "cmw/gl/extensions.hpp"
 #include "cmw/gl/object.hpp"
+#include "cmw/gl/texture_container.hpp"
+#include "cmw/utils/asset_view.hpp"
 #include "cmw/utils.hpp"
 
 namespace cmw::gl {
@@ -111,8 +114,14 @@ class Texture2dN: public TextureN<GL_TEXTURE_2D, N> {
         Texture2dN(const std::string &path, GLint idx = -1,
                 GLenum load_data_fmt = GL_UNSIGNED_BYTE, GLuint mipmap_lvl = 0): Texture2dN(idx) {
             int w, h, nchan, fmt;
+            auto file = map_asset(path);
+            if (TextureContainer container; container.parse(file.data(), file.size())) {
+                set_data(container);
+                return;
+            }
+
             stbi_set_flip_vertically_on_load(true);
-            stbi_uc *data = stbi_load_from_file(open_asset(path), &w, &h, &nchan, 0);
+            stbi_uc *data = stbi_load_from_memory(file.bytes(), file.size(), &w, &h, &nchan, 0);
             if (!data) {
                 CMW_ERROR("%s", stbi_failure_reason());
                 throw std::runtime_error("Could not load texture file");
@@ -128,16 +137,73 @@ class Texture2dN: public TextureN<GL_TEXTURE_2D, N> {
             stbi_image_free(data);
         }
 
+        inline ~Texture2dN() {
+            if (this->bindless_handle)
+                ext::MakeTextureHandleNonResident(this->bindless_handle);
+        }
+
+        // Creates the bindless handle and makes it resident on first call, requires ext::bindless_texture
+        // The texture state is immutable from then on, so respecifying its data recreates the texture object
+        inline GLuint64 get_bindless_handle() {
+            if (!this->bindless_handle) {
+                this->bindless_handle = ext::GetTextureHandle(this->get_handle());
+                ext::MakeTextureHandleResident(this->bindless_handle);
+            }
+            return this->bindless_handle;
+        }
+
+        inline bool has_bindless_handle() const { return this->bindless_handle != 0; }
+
         inline void set_data(void *data, GLuint width, GLuint height, GLenum store_fmt = GL_RGB, GLenum load_fmt = GL_RGB,
                 GLenum load_data_fmt = GL_UNSIGNED_BYTE, GLuint mipmap_lvl = 0, GLuint leg = 0) {
+            release_bindless_handle();
             glTexImage2D(this->get_type(), mipmap_lvl, store_fmt, width, height, leg, load_fmt, load_data_fmt, data);
         }
 
+        // Uploads every level of the container, compressed formats are uploaded as-is
+        inline void set_data(const TextureContainer &container) {
+            auto fmt = container.get_header().format;
+            auto gl_fmt = TextureContainer::get_gl_format(fmt);
+            release_bindless_handle();
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            for (std::uint32_t i = 0; i < container.get_nb_levels(); ++i) {
+                auto &lvl = container.get_level(i);
+                if (TextureContainer::is_compressed(fmt))
+                    glCompressedTexImage2D(this->get_type(), i, gl_fmt, lvl.width, lvl.height, 0, lvl.size,
+                        container.get_level_data(i));
+                else
+                    set_data(const_cast<void *>(container.get_level_data(i)), lvl.width, lvl.height, gl_fmt, gl_fmt,
+                        GL_UNSIGNED_BYTE, i);
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            this->set_parameters(std::pair{GL_TEXTURE_MAX_LEVEL, (GLint)container.get_nb_levels() - 1});
+            this->set_default_parameters();
+        }
+
+        inline void set_sub_data(void *data, GLint x, GLint y, GLuint width, GLuint height, GLenum load_fmt = GL_RGB,
+                GLenum load_data_fmt = GL_UNSIGNED_BYTE, GLuint mipmap_lvl = 0) {
+            glTexSubImage2D(this->get_type(), mipmap_lvl, x, y, width, height, load_fmt, load_data_fmt, data);
+        }
+
         inline void set_blank_data(GLuint width, GLint height, GLenum store_fmt = GL_RGB, GLenum load_fmt = GL_RGB,
                 GLenum load_data_fmt = GL_UNSIGNED_BYTE, GLuint mipmap_lvl = 0, GLuint leg = 0) {
             std::vector<std::uint8_t> blank_data(width * height * 4, 255);
             set_data(blank_data.data(), width, height, store_fmt, load_fmt, load_data_fmt, mipmap_lvl, leg);
         }
+
+    protected:
+        inline void release_bindless_handle() {
+            if (!this->bindless_handle)
+                return;
+            ext::MakeTextureHandleNonResident(this->bindless_handle);
+            this->bindless_handle = 0;
+            glDeleteTextures(this->get_nb(), &this->handle);
+            glGenTextures(this->get_nb(), &this->handle);
+            this->bind();
+        }
+
+    protected:
+        GLuint64 bindless_handle = 0;
 };
 
 template <std::size_t N = 1>
@@ -152,10 +218,62 @@ class Texture3dN: public TextureN<GL_TEXTURE_3D, N> {
         }
 };
 
+// Layers share their size, format and number of levels, and the storage is allocated once for all of them
+template <std::size_t N = 1>
+class Texture2dArrayN: public TextureN<GL_TEXTURE_2D_ARRAY, N> {
+    public:
+        inline Texture2dArrayN() = default;
+        inline Texture2dArrayN(int idx): TextureN<GL_TEXTURE_2D_ARRAY, N>(idx) { }
+
+        inline void set_storage(GLuint width, GLuint height, GLuint nb_layers, GLuint nb_levels = 1,
+                GLenum store_fmt = GL_RGBA8) {
+            glTexStorage3D(this->get_type(), nb_levels, store_fmt, width, height, nb_layers);
+            this->width = width, this->height = height, this->nb_layers = nb_layers, this->nb_levels = nb_levels;
+        }
+
+        inline void set_layer_data(GLuint layer, void *data, GLuint width, GLuint height, GLenum load_fmt = GL_RGBA,
+                GLenum load_data_fmt = GL_UNSIGNED_BYTE, GLuint mipmap_lvl = 0) {
+            glTexSubImage3D(this->get_type(), mipmap_lvl, 0, 0, layer, width, height, 1, load_fmt, load_data_fmt, data);
+        }
+
+        // The container must match the storage, see set_storage(const TextureContainer &, GLuint)
+        inline void set_layer_data(GLuint layer, const TextureContainer &container) {
+            auto fmt = container.get_header().format;
+            auto gl_fmt = TextureContainer::get_gl_format(fmt);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            for (std::uint32_t i = 0; i < container.get_nb_levels(); ++i) {
+                auto &lvl = container.get_level(i);
+                if (TextureContainer::is_compressed(fmt))
+                    glCompressedTexSubImage3D(this->get_type(), i, 0, 0, layer, lvl.width, lvl.height, 1, gl_fmt,
+                        lvl.size, container.get_level_data(i));
+                else
+                    set_layer_data(layer, const_cast<void *>(container.get_level_data(i)), lvl.width, lvl.height,
+                        gl_fmt, GL_UNSIGNED_BYTE, i);
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        }
+
+        // Allocates storage for nb_layers images shaped like the container
+        inline void set_storage(const TextureContainer &container, GLuint nb_layers) {
+            auto &hdr = container.get_header();
+            set_storage(hdr.width, hdr.height, nb_layers, hdr.nb_levels, TextureContainer::get_gl_internal_format(hdr.format));
+            this->set_default_parameters();
+        }
+
+        inline GLuint get_width()     const { return this->width; }
+        inline GLuint get_height()    const { return this->height; }
+        inline GLuint get_nb_layers() const { return this->nb_layers; }
+        inline GLuint get_nb_levels() const { return this->nb_levels; }
+
+    protected:
+        GLuint width = 0, height = 0, nb_layers = 0, nb_levels = 0;
+};
+
 template <GLenum Type>
-using Texture   = TextureN<Type, 1>;
-using Texture1d = Texture1dN<1>;
-using Texture2d = Texture2dN<1>;
-using Texture3d = Texture3dN<1>;
+using Texture        = TextureN<Type, 1>;
+using Texture1d      = Texture1dN<1>;
+using Texture2d      = Texture2dN<1>;
+using Texture3d      = Texture3dN<1>;
+using Texture2dArray = Texture2dArrayN<1>;
 
 } // namespace cmw::gl
@@ -0,0 +1,162 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <glad/glad.h>
+
+#include "cmw/gl/extensions.hpp"
+
+namespace cmw::gl {
+
+// GPU-ready texture: a full mip chain, stored either uncompressed or block-compressed, uploaded without decoding
+// Layout: header | level descriptors | level data, each level aligned to 16 bytes
+class TextureContainer {
+    public:
+        enum class Format: std::uint32_t {
+            R8,
+            Rgb8,
+            Rgba8,
+            Bc1, // S3TC DXT1, opaque
+            Bc3, // S3TC DXT5, with alpha
+        };
+
+        struct Header {
+            std::uint32_t magic, version;
+            Format format;
+            std::uint32_t width, height, nb_levels;
+            std::uint64_t source_hash; // Hash of the encoded image this was converted from
+        };
+
+        struct Level {
+            std::uint64_t offset, size;
+            std::uint32_t width, height;
+        };
+
+        static constexpr std::uint32_t magic   = 0x54574d43; // "CMWT"
+        static constexpr std::uint32_t version = 1;
+
+    public:
+        // Parses the container in place, the data must outlive it
+        inline bool parse(const void *data, std::size_t size) {
+            auto *bytes = static_cast<const std::uint8_t *>(data);
+            this->header = nullptr, this->levels = nullptr, this->base = bytes;
+            if (!data || (size < sizeof(Header)))
+                return false;
+
+            // Containers are read from disk, so everything the upload relies on is checked
+            auto *hdr = reinterpret_cast<const Header *>(bytes);
+            if ((hdr->magic != magic) || (hdr->version != version) || (hdr->format > Format::Bc3)
+                    || (hdr->nb_levels == 0) || (size < sizeof(Header) + (std::uint64_t)hdr->nb_levels * sizeof(Level)))
+                return false;
+
+            auto *lvls = reinterpret_cast<const Level *>(hdr + 1);
+            for (std::uint32_t i = 0; i < hdr->nb_levels; ++i) {
+                if ((lvls[i].size > size) || (lvls[i].offset > size - lvls[i].size)
+                        || (lvls[i].size < get_level_size(hdr->format, lvls[i].width, lvls[i].height)))
+                    return false;
+            }
+
+            this->header = hdr, this->levels = lvls;
+            return true;
+        }
+
+        inline explicit operator bool() const { return this->header != nullptr; }
+
+        inline const Header &get_header()    const { return *this->header; }
+        inline std::uint32_t get_nb_levels() const { return this->header->nb_levels; }
+        inline const Level  &get_level(std::uint32_t lvl)      const { return this->levels[lvl]; }
+        inline const void   *get_level_data(std::uint32_t lvl) const { return this->base + this->levels[lvl].offset; }
+
+        // Size of the pixel data of all levels, ie. the memory used once uploaded
+        inline std::size_t get_data_size() const {
+            std::size_t size = 0;
+            for (std::uint32_t i = 0; i < get_nb_levels(); ++i)
+                size += this->levels[i].size;
+            return size;
+        }
+
+        static constexpr inline bool is_compressed(Format fmt) {
+            return (fmt == Format::Bc1) || (fmt == Format::Bc3);
+        }
+
+        // Internal format for compressed textures, format for uncompressed ones
+        static constexpr inline GLenum get_gl_format(Format fmt) {
+            switch (fmt) {
+                case Format::R8:    return GL_RED;
+                case Format::Rgb8:  return GL_RGB;
+                case Format::Rgba8: return GL_RGBA;
+                case Format::Bc1:   return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+                case Format::Bc3:   return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            }
+            return GL_RGBA;
+        }
+
+        // Sized internal format, as required for immutable storage
+        static constexpr inline GLenum get_gl_internal_format(Format fmt) {
+            switch (fmt) {
+                case Format::R8:    return GL_R8;
+                case Format::Rgb8:  return GL_RGB8;
+                case Format::Rgba8: return GL_RGBA8;
+                default:            return get_gl_format(fmt);
+            }
+        }
+
+        static constexpr inline std::size_t get_level_size(Format fmt, std::uint32_t width, std::uint32_t height) {
+            std::size_t blocks = (std::size_t)((width + 3) / 4) * ((height + 3) / 4);
+            switch (fmt) {
+                case Format::R8:    return (std::size_t)width * height;
+                case Format::Rgb8:  return (std::size_t)width * height * 3;
+                case Format::Rgba8: return (std::size_t)width * height * 4;
+                case Format::Bc1:   return blocks * 8;
+                case Format::Bc3:   return blocks * 16;
+            }
+            return 0;
+        }
+
+        // Serializes a mip chain, level i is expected to be max(width >> i, 1) x max(height >> i, 1)
+        static inline std::vector<std::uint8_t> build(Format fmt, std::uint32_t width, std::uint32_t height,
+                std::uint64_t source_hash, const std::vector<std::vector<std::uint8_t>> &levels) {
+            auto align = [](std::size_t off) { return (off + 15) & ~(std::size_t)15; };
+
+            Header hdr = {magic, version, fmt, width, height, (std::uint32_t)levels.size(), source_hash};
+            std::vector<Level> lvls;
+            std::size_t offset = align(sizeof(Header) + levels.size() * sizeof(Level));
+            for (std::size_t i = 0; i < levels.size(); ++i) {
+                lvls.push_back({offset, levels[i].size(),
+                    std::max(width >> i, (std::uint32_t)1), std::max(height >> i, (std::uint32_t)1)});
+                offset = align(offset + levels[i].size());
+            }
+
+            std::vector<std::uint8_t> out(offset, 0);
+            std::memcpy(out.data(), &hdr, sizeof(hdr));
+            std::memcpy(out.data() + sizeof(hdr), lvls.data(), lvls.size() * sizeof(Level));
+            for (std::size_t i = 0; i < levels.size(); ++i)
+                std::copy(levels[i].begin(), levels[i].end(), out.begin() + lvls[i].offset);
+            return out;
+        }
+
+    private:
+        const Header       *header = nullptr;
+        const Level        *levels = nullptr;
+        const std::uint8_t *base   = nullptr;
+};
+
+} // namespace cmw::gl
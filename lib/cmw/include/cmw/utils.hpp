@@ -107,7 +107,11 @@ static inline void unbind_all(Args &&...args) {
 #include "cmw/utils/asset.hpp"
 #include "cmw/utils/color.hpp"
 #include "cmw/utils/error.hpp"
+#include "cmw/utils/hash.hpp"
+#include "cmw/utils/mapped_file.hpp"
 #include "cmw/utils/position.hpp"
 #include "cmw/utils/result.hpp"
 #include "cmw/utils/scope_guard.hpp"
+#include "cmw/utils/thread_pool.hpp"
 #include "cmw/utils/time.hpp"
+#include "cmw/utils/unicode.hpp"
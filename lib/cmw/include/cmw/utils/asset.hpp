@@ -5,7 +5,9 @@
 namespace cmw {
 
 // Forward declarations
+class AssetView;
 template <typename T> T read_asset(const std::string &path);
 FILE *open_asset(const std::string &path, const std::string &mode = "r");
+AssetView map_asset(const std::string &path);
 
 } // namespace cmw
@@ -0,0 +1,92 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "cmw/utils/mapped_file.hpp"
+#include "cmw/utils.hpp"
+
+namespace cmw {
+
+// Read-only contiguous bytes of an asset, with std::span<const std::byte> semantics
+// The view either owns a file mapping, owns a buffer (eg. decompressed data), or borrows memory owned elsewhere
+class AssetView {
+    CMW_NON_COPYABLE(AssetView);
+
+    public:
+        using element_type = const std::byte;
+        using value_type   = std::byte;
+        using size_type    = std::size_t;
+        using pointer      = const std::byte *;
+        using iterator     = const std::byte *;
+
+    public:
+        inline AssetView() = default;
+
+        inline AssetView(MappedFile &&file): file(std::move(file)) {
+            this->ptr = reinterpret_cast<pointer>(this->file.data()), this->sz = this->file.size();
+        }
+
+        inline AssetView(std::vector<std::uint8_t> &&buffer): buffer(std::move(buffer)) {
+            this->ptr = reinterpret_cast<pointer>(this->buffer.data()), this->sz = this->buffer.size();
+        }
+
+        // The memory must outlive the view
+        inline AssetView(const void *data, std::size_t size): ptr(static_cast<pointer>(data)), sz(size) { }
+
+        inline AssetView(AssetView &&other) {
+            *this = std::move(other);
+        }
+
+        inline AssetView &operator=(AssetView &&other) {
+            // Moving a vector keeps its storage, and a mapping doesn't move, so the pointer stays valid
+            this->file   = std::move(other.file);
+            this->buffer = std::move(other.buffer);
+            this->ptr    = std::exchange(other.ptr, nullptr);
+            this->sz     = std::exchange(other.sz, 0);
+            return *this;
+        }
+
+        inline pointer   data()  const { return this->ptr; }
+        inline size_type size()  const { return this->sz; }
+        inline bool      empty() const { return !this->sz; }
+
+        inline iterator begin() const { return this->ptr; }
+        inline iterator end()   const { return this->ptr + this->sz; }
+
+        inline const std::byte &operator[](size_type idx) const { return this->ptr[idx]; }
+
+        inline explicit operator bool() const { return this->ptr != nullptr; }
+
+        // Helpers for C APIs taking unsigned char/char pointers
+        inline const std::uint8_t *bytes() const { return reinterpret_cast<const std::uint8_t *>(this->ptr); }
+        inline std::string_view    str()   const { return {reinterpret_cast<const char *>(this->ptr), this->sz}; }
+
+    private:
+        MappedFile file;
+        std::vector<std::uint8_t> buffer;
+        pointer ptr = nullptr;
+        size_type sz = 0;
+};
+
+} // namespace cmw
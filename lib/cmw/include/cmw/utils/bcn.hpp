@@ -0,0 +1,146 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+
+namespace cmw::bcn {
+
+// Fast BC1/BC3 (S3TC) encoders, endpoints are the inset bounding box of each block
+// Quality is below offline encoders but encoding is cheap enough to run at load time
+
+namespace impl {
+
+inline std::uint16_t to_565(int r, int g, int b) {
+    return ((r * 31 + 127) / 255) << 11 | ((g * 63 + 127) / 255) << 5 | ((b * 31 + 127) / 255);
+}
+
+inline void from_565(std::uint16_t c, int &r, int &g, int &b) {
+    r = (c >> 11) & 0x1f, g = (c >> 5) & 0x3f, b = c & 0x1f;
+    r = (r << 3) | (r >> 2), g = (g << 2) | (g >> 4), b = (b << 3) | (b >> 2);
+}
+
+// Gathers the 4x4 block at (bx, by) as RGBA, clamping at the image edges
+inline void fetch_block(const std::uint8_t *src, int width, int height, int nchan, int bx, int by, std::uint8_t (&block)[16][4]) {
+    for (int y = 0; y < 4; ++y) {
+        for (int x = 0; x < 4; ++x) {
+            auto *px = src + ((std::size_t)std::min(by + y, height - 1) * width + std::min(bx + x, width - 1)) * nchan;
+            auto *dst = block[y * 4 + x];
+            dst[0] = px[0], dst[1] = px[nchan > 1], dst[2] = px[(nchan > 2) * 2], dst[3] = (nchan > 3) ? px[3] : 255;
+        }
+    }
+}
+
+inline void encode_color(const std::uint8_t (&block)[16][4], std::uint8_t *out) {
+    int min[3] = {255, 255, 255}, max[3] = {0, 0, 0};
+    for (auto &px: block) {
+        for (int c = 0; c < 3; ++c)
+            min[c] = std::min<int>(min[c], px[c]), max[c] = std::max<int>(max[c], px[c]);
+    }
+    for (int c = 0; c < 3; ++c) { // Inset the box to reduce the error on the endpoints
+        int inset = (max[c] - min[c]) / 16;
+        min[c] += inset, max[c] -= inset;
+    }
+
+    std::uint16_t c0 = to_565(max[0], max[1], max[2]), c1 = to_565(min[0], min[1], min[2]);
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    int palette[4][3];
+    from_565(c0, palette[0][0], palette[0][1], palette[0][2]);
+    from_565(c1, palette[1][0], palette[1][1], palette[1][2]);
+    for (int c = 0; c < 3; ++c) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    std::uint32_t indices = 0;
+    if (c0 != c1) { // Otherwise the block is uniform and all indices are 0
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, best_dist = 1 << 30;
+            for (int p = 0; p < 4; ++p) {
+                int dr = block[i][0] - palette[p][0], dg = block[i][1] - palette[p][1], db = block[i][2] - palette[p][2];
+                if (int dist = dr * dr + dg * dg + db * db; dist < best_dist)
+                    best = p, best_dist = dist;
+            }
+            indices |= best << (2 * i);
+        }
+    }
+
+    out[0] = c0 & 0xff, out[1] = c0 >> 8, out[2] = c1 & 0xff, out[3] = c1 >> 8;
+    for (int i = 0; i < 4; ++i)
+        out[4 + i] = indices >> (8 * i);
+}
+
+inline void encode_alpha(const std::uint8_t (&block)[16][4], std::uint8_t *out) {
+    int a0 = 0, a1 = 255;
+    for (auto &px: block)
+        a0 = std::max<int>(a0, px[3]), a1 = std::min<int>(a1, px[3]);
+
+    // 8-value mode (a0 > a1): a0, a1, then 6 interpolated values from a0 to a1
+    int palette[8] = {a0, a1};
+    for (int i = 1; i < 7; ++i)
+        palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+
+    std::uint64_t indices = 0;
+    if (a0 != a1) {
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, best_dist = 1 << 30;
+            for (int p = 0; p < 8; ++p) {
+                if (int dist = std::abs(block[i][3] - palette[p]); dist < best_dist)
+                    best = p, best_dist = dist;
+            }
+            indices |= (std::uint64_t)best << (3 * i);
+        }
+    }
+
+    out[0] = a0, out[1] = a1;
+    for (int i = 0; i < 6; ++i)
+        out[2 + i] = indices >> (8 * i);
+}
+
+} // namespace impl
+
+// src is width x height pixels of nchan 8-bit channels, blocks are appended to dst in row-major order
+inline void encode_bc1(const std::uint8_t *src, int width, int height, int nchan, std::vector<std::uint8_t> &dst) {
+    std::uint8_t block[16][4];
+    for (int by = 0; by < height; by += 4) {
+        for (int bx = 0; bx < width; bx += 4) {
+            impl::fetch_block(src, width, height, nchan, bx, by, block);
+            dst.resize(dst.size() + 8);
+            impl::encode_color(block, dst.data() + dst.size() - 8);
+        }
+    }
+}
+
+inline void encode_bc3(const std::uint8_t *src, int width, int height, int nchan, std::vector<std::uint8_t> &dst) {
+    std::uint8_t block[16][4];
+    for (int by = 0; by < height; by += 4) {
+        for (int bx = 0; bx < width; bx += 4) {
+            impl::fetch_block(src, width, height, nchan, bx, by, block);
+            dst.resize(dst.size() + 16);
+            impl::encode_alpha(block, dst.data() + dst.size() - 16);
+            impl::encode_color(block, dst.data() + dst.size() - 8);
+        }
+    }
+}
+
+} // namespace cmw::bcn
@@ -0,0 +1,97 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "cmw/utils.hpp"
+
+namespace cmw {
+
+template <typename Sig, std::size_t Size = 4 * sizeof(void *)>
+class Delegate;
+
+// Type-erased callable stored inline, so that it never allocates
+// Callables larger than Size bytes are rejected at compile time. Move-only
+template <typename R, typename ...Args, std::size_t Size>
+class Delegate<R(Args...), Size> {
+    CMW_NON_COPYABLE(Delegate);
+
+    public:
+        inline Delegate() = default;
+
+        template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Delegate>>>
+        inline Delegate(F &&f) {
+            using Fn = std::decay_t<F>;
+            static_assert(sizeof(Fn) <= Size, "Callable too large for Delegate");
+            static_assert(alignof(Fn) <= alignof(std::max_align_t), "Callable over-aligned for Delegate");
+            static_assert(std::is_nothrow_move_constructible_v<Fn>, "Callable must be nothrow move-constructible");
+
+            new (this->storage) Fn(std::forward<F>(f));
+            this->invoke_fn = [](void *storage, Args ...args) -> R {
+                return (*static_cast<Fn *>(storage))(std::forward<Args>(args)...);
+            };
+            this->manage_fn = [](void *dst, void *src) {
+                if (dst)
+                    new (dst) Fn(std::move(*static_cast<Fn *>(src)));
+                static_cast<Fn *>(src)->~Fn();
+            };
+        }
+
+        inline Delegate(Delegate &&other) {
+            *this = std::move(other);
+        }
+
+        inline Delegate &operator=(Delegate &&other) {
+            if (this == &other)
+                return *this;
+            reset();
+            if (other.manage_fn) {
+                other.manage_fn(this->storage, other.storage);
+                this->invoke_fn = std::exchange(other.invoke_fn, nullptr);
+                this->manage_fn = std::exchange(other.manage_fn, nullptr);
+            }
+            return *this;
+        }
+
+        inline ~Delegate() {
+            reset();
+        }
+
+        inline void reset() {
+            if (this->manage_fn)
+                this->manage_fn(nullptr, this->storage);
+            this->invoke_fn = nullptr, this->manage_fn = nullptr;
+        }
+
+        inline R operator()(Args ...args) {
+            return this->invoke_fn(this->storage, std::forward<Args>(args)...);
+        }
+
+        inline explicit operator bool() const { return this->invoke_fn != nullptr; }
+
+    protected:
+        alignas(std::max_align_t) unsigned char storage[Size];
+        R (*invoke_fn)(void *, Args...) = nullptr;
+        void (*manage_fn)(void *dst, void *src) = nullptr; // Moves src into dst unless null, then destroys src
+};
+
+} // namespace cmw
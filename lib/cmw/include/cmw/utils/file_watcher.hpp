@@ -0,0 +1,128 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cmw/core/log.hpp"
+#include "cmw/utils.hpp"
+#include "cmw/platform.h"
+
+#if defined(CMW_PC) && defined(__linux__)
+#   define CMW_HAS_FILE_WATCHER
+#   include <dirent.h>
+#   include <fcntl.h>
+#   include <sys/inotify.h>
+#   include <unistd.h>
+#endif
+
+namespace cmw {
+
+// Reports files written under a directory tree, using inotify on Linux
+// Elsewhere the watcher is always invalid and never reports anything
+class FileWatcher {
+    CMW_NON_COPYABLE(FileWatcher);
+    CMW_NON_MOVEABLE(FileWatcher);
+
+    public:
+        inline FileWatcher(const std::string &root): root(root) {
+#ifdef CMW_HAS_FILE_WATCHER
+            if ((this->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+                CMW_ERROR("Failed to initialize inotify\n");
+                return;
+            }
+            add_directory("");
+#endif
+        }
+
+        inline ~FileWatcher() {
+#ifdef CMW_HAS_FILE_WATCHER
+            if (this->fd >= 0)
+                close(this->fd);
+#endif
+        }
+
+        inline explicit operator bool() const {
+            return this->fd >= 0;
+        }
+
+        // Appends the paths, relative to the root, of the files written or moved in since the last call
+        // Each path is reported once per call even if it was written several times. Never blocks
+        inline void poll(std::vector<std::string> &changed) {
+#ifdef CMW_HAS_FILE_WATCHER
+            if (this->fd < 0)
+                return;
+
+            alignas(inotify_event) char buf[0x1000];
+            std::size_t first = changed.size();
+            ssize_t len;
+            while ((len = read(this->fd, buf, sizeof(buf))) > 0) {
+                for (char *ptr = buf; ptr < buf + len;) {
+                    auto *event = reinterpret_cast<inotify_event *>(ptr);
+                    ptr += sizeof(inotify_event) + event->len;
+
+                    auto it = this->dirs.find(event->wd);
+                    if ((it == this->dirs.end()) || !event->len)
+                        continue;
+                    auto path = it->second + event->name;
+                    if (event->mask & IN_ISDIR) {
+                        if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                            add_directory(path + '/');
+                    } else if ((event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                            && (std::find(changed.begin() + first, changed.end(), path) == changed.end())) {
+                        changed.push_back(std::move(path));
+                    }
+                }
+            }
+#endif
+        }
+
+        inline const std::string &get_root() const { return this->root; }
+
+    private:
+#ifdef CMW_HAS_FILE_WATCHER
+        inline void add_directory(const std::string &rel_path) {
+            auto path = this->root + rel_path;
+            int wd = inotify_add_watch(this->fd, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR);
+            if (wd < 0) {
+                CMW_WARN("Failed to watch %s\n", path.c_str());
+                return;
+            }
+            this->dirs[wd] = rel_path;
+
+            DIR *dir = opendir(path.c_str());
+            if (!dir)
+                return;
+            while (auto *entry = readdir(dir))
+                if ((entry->d_type == DT_DIR) && (entry->d_name[0] != '.'))
+                    add_directory(rel_path + entry->d_name + '/');
+            closedir(dir);
+        }
+#endif
+
+    private:
+        std::string root;
+        int fd = -1;
+        std::unordered_map<int, std::string> dirs; // Watch descriptor to path relative to the root
+};
+
+} // namespace cmw
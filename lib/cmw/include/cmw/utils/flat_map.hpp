@@ -0,0 +1,145 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cmw {
+
+// Open-addressing hash map with linear probing, for integer keys such as interned IDs
+// The two largest key values are reserved. Insertions invalidate pointers to values
+template <typename K, typename V>
+class FlatMap {
+    static_assert(std::is_unsigned_v<K>, "FlatMap keys must be unsigned integers");
+
+    public:
+        static constexpr K Empty = ~K(0), Tombstone = ~K(0) - 1;
+
+    public:
+        inline FlatMap(std::size_t capacity = 16) {
+            rehash(capacity);
+        }
+
+        inline V *find(K key) {
+            auto &slot = this->slots[probe(key)];
+            return (slot.key == key) ? &*slot.value : nullptr;
+        }
+
+        inline const V *find(K key) const {
+            return const_cast<FlatMap *>(this)->find(key);
+        }
+
+        template <typename ...Args>
+        std::pair<V *, bool> try_emplace(K key, Args &&...args) {
+            if (auto *value = find(key))
+                return {value, false};
+
+            // Tombstones count towards the load factor, so that probe chains stay short
+            if ((this->nb_used + 1) * 4 > this->slots.size() * 3)
+                rehash(std::max(this->nb_alive * 4, this->slots.size()));
+
+            std::size_t mask = this->slots.size() - 1;
+            std::size_t idx = hash(key) & mask;
+            while ((this->slots[idx].key != Empty) && (this->slots[idx].key != Tombstone))
+                idx = (idx + 1) & mask;
+
+            auto &slot = this->slots[idx];
+            this->nb_used += slot.key == Empty;
+            ++this->nb_alive;
+            slot.key = key;
+            slot.value.emplace(std::forward<Args>(args)...);
+            return {&*slot.value, true};
+        }
+
+        inline bool erase(K key) {
+            auto &slot = this->slots[probe(key)];
+            if (slot.key != key)
+                return false;
+            slot.key = Tombstone;
+            slot.value.reset();
+            --this->nb_alive;
+            return true;
+        }
+
+        inline void clear() {
+            for (auto &slot: this->slots)
+                slot.key = Empty, slot.value.reset();
+            this->nb_used = this->nb_alive = 0;
+        }
+
+        // Calls f(key, value) for each element, in no particular order
+        template <typename F>
+        inline void for_each(F &&f) {
+            for (auto &slot: this->slots)
+                if ((slot.key != Empty) && (slot.key != Tombstone))
+                    f(slot.key, *slot.value);
+        }
+
+        template <typename F>
+        inline void for_each(F &&f) const {
+            for (auto &slot: this->slots)
+                if ((slot.key != Empty) && (slot.key != Tombstone))
+                    f(slot.key, *slot.value);
+        }
+
+        inline std::size_t size()  const { return this->nb_alive; }
+        inline bool        empty() const { return !this->nb_alive; }
+
+    private:
+        struct Slot {
+            K key = Empty;
+            std::optional<V> value;
+        };
+
+        static inline std::size_t hash(K key) {
+            // Fibonacci hashing, IDs are sequential so their low bits alone would cluster
+            std::uint64_t h = (std::uint64_t)key * 0x9e3779b97f4a7c15ull;
+            return h ^ (h >> 32);
+        }
+
+        // Index of the slot holding the key, or of the empty slot ending its probe chain
+        inline std::size_t probe(K key) const {
+            std::size_t mask = this->slots.size() - 1;
+            std::size_t idx = hash(key) & mask;
+            while ((this->slots[idx].key != key) && (this->slots[idx].key != Empty))
+                idx = (idx + 1) & mask;
+            return idx;
+        }
+
+        void rehash(std::size_t capacity) {
+            std::size_t size = 16;
+            while (size < capacity)
+                size *= 2;
+
+            auto old = std::exchange(this->slots, std::vector<Slot>(size));
+            this->nb_used = this->nb_alive = 0;
+            for (auto &slot: old)
+                if ((slot.key != Empty) && (slot.key != Tombstone))
+                    try_emplace(slot.key, std::move(*slot.value));
+        }
+
+    private:
+        std::vector<Slot> slots;
+        std::size_t nb_used = 0, nb_alive = 0; // Used slots include tombstones
+};
+
+} // namespace cmw
@@ -0,0 +1,167 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "cmw/utils.hpp"
+
+namespace cmw {
+
+// Owns objects referred to by generational, reference-counted handles
+// An object is destroyed once its last handle is released, and handles to a destroyed object are detected
+// through the generation of its slot, which is bumped each time the slot is reused
+// The pool must outlive its handles, and isn't thread-safe
+template <typename T>
+class HandlePool {
+    CMW_NON_COPYABLE(HandlePool);
+    CMW_NON_MOVEABLE(HandlePool);
+
+    public:
+        class Handle {
+            friend class HandlePool;
+
+            public:
+                inline Handle() = default;
+
+                inline Handle(const Handle &other): pool(other.pool), idx(other.idx), generation(other.generation) {
+                    if (*this)
+                        ++this->pool->slots[this->idx].refcount;
+                }
+
+                inline Handle(Handle &&other):
+                    pool(std::exchange(other.pool, nullptr)), idx(other.idx), generation(other.generation) { }
+
+                inline Handle &operator=(Handle other) {
+                    std::swap(this->pool, other.pool);
+                    std::swap(this->idx, other.idx);
+                    std::swap(this->generation, other.generation);
+                    return *this;
+                }
+
+                inline ~Handle() {
+                    reset();
+                }
+
+                inline void reset() {
+                    if (*this)
+                        std::exchange(this->pool, nullptr)->release(this->idx);
+                }
+
+                // Null if the handle is empty or the object was destroyed
+                inline T *get() const {
+                    if (!this->pool)
+                        return nullptr;
+                    auto &slot = this->pool->slots[this->idx];
+                    return (slot.generation == this->generation) ? slot.object.get() : nullptr;
+                }
+
+                inline T &operator*()  const { return *get(); }
+                inline T *operator->() const { return get(); }
+
+                inline explicit operator bool() const { return get(); }
+
+                inline bool operator==(const Handle &rhs) const {
+                    return (this->pool == rhs.pool) && (this->idx == rhs.idx) && (this->generation == rhs.generation);
+                }
+
+                inline bool operator!=(const Handle &rhs) const {
+                    return !(*this == rhs);
+                }
+
+                inline std::uint32_t get_use_count() const {
+                    return *this ? this->pool->slots[this->idx].refcount : 0;
+                }
+
+                inline std::uint64_t get_last_used() const {
+                    return *this ? this->pool->slots[this->idx].last_used : 0;
+                }
+
+                inline std::uint32_t get_idx()        const { return this->idx; }
+                inline std::uint32_t get_generation() const { return this->generation; }
+
+            private:
+                inline Handle(HandlePool *pool, std::uint32_t idx, std::uint32_t generation):
+                    pool(pool), idx(idx), generation(generation) { }
+
+            private:
+                HandlePool   *pool = nullptr;
+                std::uint32_t idx = 0, generation = 0;
+        };
+
+    public:
+        inline HandlePool() = default;
+
+        template <typename ...Args>
+        inline Handle create(Args &&...args) {
+            std::uint32_t idx;
+            if (!this->free_slots.empty()) {
+                idx = this->free_slots.back();
+                this->free_slots.pop_back();
+            } else {
+                idx = this->slots.size();
+                this->slots.emplace_back();
+            }
+            auto &slot = this->slots[idx];
+            slot.object    = std::make_unique<T>(std::forward<Args>(args)...);
+            slot.refcount  = 1;
+            slot.last_used = this->clock;
+            ++this->nb_alive;
+            return Handle(this, idx, slot.generation);
+        }
+
+        // Marks the object as used at the current clock value, for LRU eviction
+        inline void touch(const Handle &handle) {
+            if (handle)
+                this->slots[handle.idx].last_used = this->clock;
+        }
+
+        inline void set_clock(std::uint64_t clock) { this->clock = clock; }
+        inline std::uint64_t get_clock() const { return this->clock; }
+
+        inline std::size_t size() const { return this->nb_alive; }
+
+    private:
+        struct Slot {
+            std::unique_ptr<T> object;
+            std::uint32_t generation = 0, refcount = 0;
+            std::uint64_t last_used = 0;
+        };
+
+        inline void release(std::uint32_t idx) {
+            auto &slot = this->slots[idx];
+            slot.last_used = this->clock;
+            if (--slot.refcount)
+                return;
+            slot.object.reset();
+            ++slot.generation;
+            --this->nb_alive;
+            this->free_slots.push_back(idx);
+        }
+
+    private:
+        std::vector<Slot> slots;
+        std::vector<std::uint32_t> free_slots;
+        std::size_t nb_alive = 0;
+        std::uint64_t clock = 0;
+};
+
+} // namespace cmw
@@ -0,0 +1,42 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace cmw {
+
+// 64-bit FNV-1a, used to key on-disk caches
+constexpr std::uint64_t fnv1a_basis = 0xcbf29ce484222325ull;
+constexpr std::uint64_t fnv1a_prime = 0x100000001b3ull;
+
+constexpr inline std::uint64_t fnv1a(const void *data, std::size_t size, std::uint64_t hash = fnv1a_basis) {
+    auto *bytes = static_cast<const std::uint8_t *>(data);
+    for (std::size_t i = 0; i < size; ++i)
+        hash = (hash ^ bytes[i]) * fnv1a_prime;
+    return hash;
+}
+
+constexpr inline std::uint64_t fnv1a(std::string_view str, std::uint64_t hash = fnv1a_basis) {
+    for (char c: str)
+        hash = (hash ^ (std::uint8_t)c) * fnv1a_prime;
+    return hash;
+}
+
+} // namespace cmw
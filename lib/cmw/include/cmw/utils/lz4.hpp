@@ -0,0 +1,153 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace cmw::lz4 {
+
+// Minimal implementation of the LZ4 block format (https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md)
+// Output is compatible with the reference decoder, compression is greedy and favors simplicity over ratio
+
+constexpr std::size_t min_match     = 4;
+constexpr std::size_t last_literals = 5;  // The last 5 bytes are always literals
+constexpr std::size_t match_limit   = 12; // The last match must start at least 12 bytes before the end
+constexpr std::size_t max_offset    = 0xffff;
+constexpr std::size_t hash_log      = 12;
+
+constexpr inline std::size_t compress_bound(std::size_t size) {
+    return size + size / 255 + 16;
+}
+
+// A block can't expand more than this, each input byte adds at most 255 bytes to a match
+constexpr inline std::size_t decompress_bound(std::size_t size) {
+    return size * 255 + 16;
+}
+
+namespace impl {
+
+inline std::uint32_t read32(const std::uint8_t *ptr) {
+    std::uint32_t val;
+    std::memcpy(&val, ptr, sizeof(val));
+    return val;
+}
+
+inline void write_length(std::vector<std::uint8_t> &dst, std::size_t len) {
+    for (; len >= 0xff; len -= 0xff)
+        dst.push_back(0xff);
+    dst.push_back(len);
+}
+
+inline void write_sequence(std::vector<std::uint8_t> &dst, const std::uint8_t *literals, std::size_t nb_literals,
+        std::size_t offset, std::size_t match_len) {
+    std::size_t ml = match_len ? match_len - min_match : 0;
+    dst.push_back((std::min<std::size_t>(nb_literals, 15) << 4) | std::min<std::size_t>(ml, 15));
+    if (nb_literals >= 15)
+        write_length(dst, nb_literals - 15);
+    dst.insert(dst.end(), literals, literals + nb_literals);
+    if (!match_len) // Last sequence
+        return;
+    dst.push_back(offset & 0xff), dst.push_back(offset >> 8);
+    if (ml >= 15)
+        write_length(dst, ml - 15);
+}
+
+} // namespace impl
+
+// Appends the compressed block to dst
+inline void compress(const void *data, std::size_t size, std::vector<std::uint8_t> &dst) {
+    auto *src = static_cast<const std::uint8_t *>(data);
+    dst.reserve(dst.size() + compress_bound(size));
+
+    std::size_t anchor = 0;
+    if (size > match_limit) {
+        std::vector<std::int32_t> table(1 << hash_log, -1);
+        auto hash = [](std::uint32_t seq) { return (seq * 2654435761u) >> (32 - hash_log); };
+
+        for (std::size_t i = 0; i + match_limit < size;) {
+            auto seq = impl::read32(src + i);
+            auto &slot = table[hash(seq)];
+            std::int32_t cand = std::exchange(slot, i);
+            if ((cand < 0) || (i - cand > max_offset) || (impl::read32(src + cand) != seq)) {
+                ++i;
+                continue;
+            }
+
+            std::size_t len = min_match;
+            while ((i + len + last_literals < size) && (src[cand + len] == src[i + len]))
+                ++len;
+            impl::write_sequence(dst, src + anchor, i - anchor, i - cand, len);
+            i += len, anchor = i;
+        }
+    }
+    impl::write_sequence(dst, src + anchor, size - anchor, 0, 0);
+}
+
+// Returns false if the block is malformed or doesn't decompress to exactly dst_size bytes
+inline bool decompress(const void *data, std::size_t size, void *dst, std::size_t dst_size) {
+    auto *ip = static_cast<const std::uint8_t *>(data), *iend = ip + size;
+    auto *op = static_cast<std::uint8_t *>(dst), *ostart = op, *oend = op + dst_size;
+
+    auto read_length = [&](std::size_t len) -> std::size_t {
+        if (len != 15)
+            return len;
+        std::uint8_t b;
+        do {
+            if (ip >= iend)
+                return (std::size_t)-1;
+            len += b = *ip++;
+        } while (b == 0xff);
+        return len;
+    };
+
+    while (ip < iend) {
+        std::uint8_t token = *ip++;
+
+        std::size_t nb_literals = read_length(token >> 4);
+        if ((nb_literals > (std::size_t)(iend - ip)) || (nb_literals > (std::size_t)(oend - op)))
+            return false;
+        std::memcpy(op, ip, nb_literals);
+        ip += nb_literals, op += nb_literals;
+        if (ip == iend) // Last sequence has no match
+            break;
+
+        if (iend - ip < 2)
+            return false;
+        std::size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (!offset || (offset > (std::size_t)(op - ostart)))
+            return false;
+
+        std::size_t len = read_length(token & 0xf);
+        if (len == (std::size_t)-1)
+            return false;
+        len += min_match;
+        if (len > (std::size_t)(oend - op))
+            return false;
+        for (auto *match = op - offset; len; --len) // Byte by byte as the match can overlap the output
+            *op++ = *match++;
+    }
+
+    return op == oend;
+}
+
+} // namespace cmw::lz4
@@ -0,0 +1,128 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cmw/core/log.hpp"
+#include "cmw/utils.hpp"
+#include "cmw/platform.h"
+
+#ifdef CMW_PC
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+namespace cmw {
+
+// Read-only view of a whole file, memory-mapped where supported and read into memory otherwise
+class MappedFile {
+    CMW_NON_COPYABLE(MappedFile);
+
+    public:
+        inline MappedFile() = default;
+
+        inline MappedFile(const std::string &path) {
+            open(path);
+        }
+
+        inline MappedFile(MappedFile &&other) {
+            *this = std::move(other);
+        }
+
+        inline MappedFile &operator=(MappedFile &&other) {
+            close();
+#ifdef CMW_PC
+            this->ptr = std::exchange(other.ptr, nullptr);
+#else
+            this->buffer = std::move(other.buffer);
+            this->ptr    = std::exchange(other.ptr, nullptr);
+#endif
+            this->sz = std::exchange(other.sz, 0);
+            return *this;
+        }
+
+        inline ~MappedFile() {
+            close();
+        }
+
+        inline bool open(const std::string &path) {
+            close();
+#ifdef CMW_PC
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            if (fstat(fd, &st) || !st.st_size) {
+                ::close(fd);
+                return false;
+            }
+            void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (addr == MAP_FAILED)
+                return false;
+            this->ptr = static_cast<const std::uint8_t *>(addr), this->sz = st.st_size;
+#else
+            FILE *fp = fopen(path.c_str(), "rb");
+            if (!fp)
+                return false;
+            fseek(fp, 0, SEEK_END);
+            this->buffer.resize(ftell(fp));
+            fseek(fp, 0, SEEK_SET);
+            bool ok = fread(this->buffer.data(), 1, this->buffer.size(), fp) == this->buffer.size();
+            fclose(fp);
+            if (!ok || this->buffer.empty()) {
+                this->buffer.clear();
+                return false;
+            }
+            this->ptr = this->buffer.data(), this->sz = this->buffer.size();
+#endif
+            return true;
+        }
+
+        inline void close() {
+#ifdef CMW_PC
+            if (this->ptr)
+                munmap(const_cast<std::uint8_t *>(this->ptr), this->sz);
+#else
+            this->buffer.clear();
+            this->buffer.shrink_to_fit();
+#endif
+            this->ptr = nullptr, this->sz = 0;
+        }
+
+        inline const std::uint8_t *data() const { return this->ptr; }
+        inline std::size_t         size() const { return this->sz; }
+
+        inline explicit operator bool() const { return this->ptr != nullptr; }
+
+    private:
+#ifndef CMW_PC
+        std::vector<std::uint8_t> buffer;
+#endif
+        const std::uint8_t *ptr = nullptr;
+        std::size_t sz = 0;
+};
+
+} // namespace cmw
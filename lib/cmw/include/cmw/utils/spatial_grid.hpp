@@ -0,0 +1,82 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "cmw/utils/area.hpp"
+#include "cmw/utils/position.hpp"
+
+namespace cmw {
+
+// Uniform grid over a fixed region, mapping each cell to the values whose bounds overlap it
+// Bounds outside of the region are clamped to its border cells. Not thread-safe
+class SpatialGrid {
+    public:
+        inline void reset(const Position2f &min, const Position2f &max, float cell_size) {
+            this->min = min, this->cell_size = cell_size;
+            this->nb_cols = std::max((std::int32_t)std::ceil((max.x - min.x) / cell_size), 1);
+            this->nb_rows = std::max((std::int32_t)std::ceil((max.y - min.y) / cell_size), 1);
+            this->cells.resize((std::size_t)this->nb_cols * this->nb_rows);
+            clear();
+        }
+
+        // Keeps the cells allocated
+        inline void clear() {
+            for (auto &cell: this->cells)
+                cell.clear();
+        }
+
+        inline void insert(std::uint32_t value, const Areaf &bounds) {
+            auto [x0, y0] = get_cell(bounds.pos);
+            auto [x1, y1] = get_cell({bounds.pos.x + bounds.w, bounds.pos.y + bounds.h});
+            for (std::int32_t y = y0; y <= y1; ++y)
+                for (std::int32_t x = x0; x <= x1; ++x)
+                    this->cells[y * this->nb_cols + x].push_back(value);
+        }
+
+        // Calls f with every value whose bounds may contain the position, in insertion order
+        template <typename F>
+        inline void query(const Position2f &pos, F &&f) const {
+            auto [x, y] = get_cell(pos);
+            for (auto value: this->cells[y * this->nb_cols + x])
+                f(value);
+        }
+
+        inline std::int32_t get_nb_cols() const { return this->nb_cols; }
+        inline std::int32_t get_nb_rows() const { return this->nb_rows; }
+
+    protected:
+        inline Position2i get_cell(const Position2f &pos) const {
+            return {
+                std::clamp((std::int32_t)std::floor((pos.x - this->min.x) / this->cell_size), 0, this->nb_cols - 1),
+                std::clamp((std::int32_t)std::floor((pos.y - this->min.y) / this->cell_size), 0, this->nb_rows - 1),
+            };
+        }
+
+    protected:
+        Position2f min;
+        float cell_size = 1.0f;
+        std::int32_t nb_cols = 0, nb_rows = 0;
+        std::vector<std::vector<std::uint32_t>> cells;
+};
+
+} // namespace cmw
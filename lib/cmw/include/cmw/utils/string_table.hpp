@@ -0,0 +1,96 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cmw/utils/hash.hpp"
+
+namespace cmw {
+
+// Interns strings, mapping each distinct string to a sequential 32-bit ID
+// Looking up a string that is already interned doesn't allocate. Not thread-safe
+class StringTable {
+    public:
+        using Id = std::uint32_t;
+
+        static constexpr Id Invalid = ~Id(0);
+
+    public:
+        inline StringTable() {
+            this->index.resize(64, Invalid);
+        }
+
+        inline Id intern(std::string_view str) {
+            auto h = (std::uint32_t)fnv1a(str);
+            std::size_t idx = probe(str, h);
+            if (this->index[idx] != Invalid)
+                return this->index[idx];
+
+            Id id = this->strings.size();
+            this->strings.emplace_back(str);
+            this->hashes.push_back(h);
+            this->index[idx] = id;
+            if (this->strings.size() * 2 > this->index.size())
+                grow();
+            return id;
+        }
+
+        // Returns Invalid if the string was never interned
+        inline Id find(std::string_view str) const {
+            return this->index[probe(str, (std::uint32_t)fnv1a(str))];
+        }
+
+        // Strings are never moved, so references stay valid for the lifetime of the table
+        inline const std::string &get(Id id) const { return this->strings[id]; }
+
+        inline std::size_t size() const { return this->strings.size(); }
+
+    private:
+        inline std::size_t probe(std::string_view str, std::uint32_t h) const {
+            std::size_t mask = this->index.size() - 1;
+            std::size_t idx = h & mask;
+            for (Id id; (id = this->index[idx]) != Invalid; idx = (idx + 1) & mask)
+                if ((this->hashes[id] == h) && (this->strings[id] == str))
+                    break;
+            return idx;
+        }
+
+        inline void grow() {
+            std::vector<Id> index(this->index.size() * 2, Invalid);
+            std::size_t mask = index.size() - 1;
+            for (Id id = 0; id < this->strings.size(); ++id) {
+                std::size_t idx = this->hashes[id] & mask;
+                while (index[idx] != Invalid)
+                    idx = (idx + 1) & mask;
+                index[idx] = id;
+            }
+            this->index = std::move(index);
+        }
+
+    private:
+        std::deque<std::string> strings;
+        std::vector<std::uint32_t> hashes; // Indexed by ID
+        std::vector<Id> index;             // Open-addressing table of IDs, with linear probing
+};
+
+} // namespace cmw
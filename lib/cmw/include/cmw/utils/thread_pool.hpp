@@ -0,0 +1,102 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cmw/utils.hpp"
+
+namespace cmw {
+
+class ThreadPool {
+    CMW_NON_COPYABLE(ThreadPool);
+    CMW_NON_MOVEABLE(ThreadPool);
+
+    public:
+        inline ThreadPool(std::size_t nb_threads = get_default_nb_threads()) {
+            this->workers.reserve(nb_threads);
+            for (std::size_t i = 0; i < nb_threads; ++i)
+                this->workers.emplace_back([this]() { this->run(); });
+        }
+
+        inline ~ThreadPool() {
+            {
+                std::lock_guard lk(this->mtx);
+                this->should_stop = true;
+            }
+            this->cv.notify_all();
+            for (auto &worker: this->workers)
+                worker.join();
+        }
+
+        template <typename F>
+        inline auto submit(F &&f) -> std::future<std::invoke_result_t<std::decay_t<F>>> {
+            using Ret = std::invoke_result_t<std::decay_t<F>>;
+            // std::function requires a copyable target, so share ownership of the task
+            auto task = std::make_shared<std::packaged_task<Ret()>>(std::forward<F>(f));
+            auto fut  = task->get_future();
+            {
+                std::lock_guard lk(this->mtx);
+                this->tasks.emplace_back([task]() { (*task)(); });
+            }
+            this->cv.notify_one();
+            return fut;
+        }
+
+        inline std::size_t get_nb_threads() const { return this->workers.size(); }
+
+        static inline std::size_t get_default_nb_threads() {
+            return std::max(1u, std::thread::hardware_concurrency());
+        }
+
+    private:
+        inline void run() {
+            while (true) {
+                std::function<void()> task;
+                {
+                    std::unique_lock lk(this->mtx);
+                    this->cv.wait(lk, [this]() { return this->should_stop || !this->tasks.empty(); });
+                    if (this->should_stop && this->tasks.empty())
+                        return;
+                    task = std::move(this->tasks.front());
+                    this->tasks.pop_front();
+                }
+                task();
+            }
+        }
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()>> tasks;
+        std::mutex mtx;
+        std::condition_variable cv;
+        bool should_stop = false;
+};
+
+} // namespace cmw
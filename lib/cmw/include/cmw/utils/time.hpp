@@ -17,13 +17,14 @@
 
 #pragma once
 
+#include <cstdint>
 #include <chrono>
 
 using namespace std::chrono_literals;
 
 namespace cmw {
 
-template <typename C = std::chrono::system_clock, typename U = std::chrono::milliseconds>
+template <typename C = std::chrono::steady_clock, typename U = std::chrono::milliseconds>
 class StopWatch {
     public:
         using Clock = C;
@@ -47,7 +48,7 @@ class StopWatch {
         std::chrono::time_point<Clock> start;
 };
 
-template <typename Clock = std::chrono::system_clock, typename Unit = std::chrono::milliseconds>
+template <typename Clock = std::chrono::steady_clock, typename Unit = std::chrono::milliseconds>
 class Timer: public StopWatch<Clock, Unit> {
     public:
         inline Timer(Unit timeout): timeout(timeout) { }
@@ -65,4 +66,64 @@ class Timer: public StopWatch<Clock, Unit> {
         Unit timeout;
 };
 
+// Clock reading the time of the last frame ticked by a FrameClock, so that everything updated during a frame sees
+// the same time, with the pause and time scale applied
+struct FrameTime {
+    using duration   = std::chrono::nanoseconds;
+    using rep        = duration::rep;
+    using period     = duration::period;
+    using time_point = std::chrono::time_point<FrameTime>;
+    static constexpr bool is_steady = true;
+
+    static inline time_point now() { return current; }
+
+    static inline time_point current;
+};
+
+// Monotonic clock sampled once per frame
+// The frame time can be paused, scaled, or advanced by a fixed step regardless of the wall time
+class FrameClock {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+    public:
+        // Advances the frame time, returns the duration of the frame in seconds
+        inline float tick() {
+            auto now = Clock::now();
+            double wall_dt = (this->frame_idx != 0) ? std::chrono::duration<double>(now - this->last).count() : 0.0;
+            this->last = now;
+
+            double step = this->fixed_step ? this->fixed_step : wall_dt;
+            this->dt    = this->paused ? 0.0f : (float)(step * this->time_scale);
+            this->time += this->dt;
+            ++this->frame_idx;
+
+            FrameTime::current = FrameTime::time_point(
+                std::chrono::duration_cast<FrameTime::duration>(std::chrono::duration<double>(this->time)));
+            return this->dt;
+        }
+
+        // Seconds since the first frame, scaled and without the paused frames
+        inline double        get_time()        const { return this->time; }
+        inline float         get_dt()          const { return this->dt; }
+        inline std::uint64_t get_frame_index() const { return this->frame_idx; }
+
+        inline void set_paused(bool paused) { this->paused = paused; }
+        inline bool is_paused() const { return this->paused; }
+
+        inline void  set_time_scale(float scale) { this->time_scale = scale; }
+        inline float get_time_scale() const { return this->time_scale; }
+
+        // Zero goes back to the wall clock
+        inline void  set_fixed_step(float step) { this->fixed_step = step; }
+        inline float get_fixed_step() const { return this->fixed_step; }
+
+    protected:
+        Clock::time_point last;
+        double time = 0.0;
+        float dt = 0.0f, time_scale = 1.0f, fixed_step = 0.0f;
+        bool paused = false;
+        std::uint64_t frame_idx = 0;
+};
+
 } // namespace cmw
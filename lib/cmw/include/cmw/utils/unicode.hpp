@@ -0,0 +1,117 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#   include <arm_neon.h>
+#endif
+
+namespace cmw::unicode {
+
+constexpr char32_t ReplacementChar = 0xfffd;
+
+constexpr inline bool is_high_surrogate(char32_t c) { return (c >= 0xd800) && (c <= 0xdbff); }
+constexpr inline bool is_low_surrogate(char32_t c)  { return (c >= 0xdc00) && (c <= 0xdfff); }
+constexpr inline bool is_surrogate(char32_t c)      { return (c >= 0xd800) && (c <= 0xdfff); }
+
+// Length of the leading run of ASCII bytes, 16 bytes at a time where SIMD is available
+inline std::size_t ascii_prefix_length(const char *str, std::size_t size) {
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    for (; i + 16 <= size; i += 16) {
+        if (int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(str + i))); mask)
+            return i + __builtin_ctz(mask);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= size; i += 16) {
+        if (vmaxvq_u8(vld1q_u8(reinterpret_cast<const std::uint8_t *>(str + i))) & 0x80)
+            break;
+    }
+#endif
+    while ((i < size) && !(str[i] & 0x80))
+        ++i;
+    return i;
+}
+
+// Decodes one non-ASCII sequence, invalid or truncated sequences yield a replacement character and consume one byte
+inline std::size_t decode_utf8_sequence(const char *str, std::size_t size, char32_t &codepoint) {
+    auto *s = reinterpret_cast<const std::uint8_t *>(str);
+    std::size_t len;
+    char32_t min;
+    if      ((s[0] & 0xe0) == 0xc0) len = 2, min = 0x80,    codepoint = s[0] & 0x1f;
+    else if ((s[0] & 0xf0) == 0xe0) len = 3, min = 0x800,   codepoint = s[0] & 0x0f;
+    else if ((s[0] & 0xf8) == 0xf0) len = 4, min = 0x10000, codepoint = s[0] & 0x07;
+    else if (!(s[0] & 0x80))        return codepoint = s[0], 1;
+    else                            return codepoint = ReplacementChar, 1;
+
+    if (len > size)
+        return codepoint = ReplacementChar, 1;
+    for (std::size_t i = 1; i < len; ++i) {
+        if ((s[i] & 0xc0) != 0x80)
+            return codepoint = ReplacementChar, 1;
+        codepoint = (codepoint << 6) | (s[i] & 0x3f);
+    }
+
+    // Reject overlong encodings, surrogates and out-of-range values
+    if ((codepoint < min) || is_surrogate(codepoint) || (codepoint > 0x10ffff))
+        return codepoint = ReplacementChar, 1;
+    return len;
+}
+
+template <typename F>
+inline void for_each_codepoint(std::string_view str, F &&f) {
+    const char *data = str.data();
+    std::size_t size = str.size(), i = 0;
+    while (i < size) {
+        for (std::size_t end = i + ascii_prefix_length(data + i, size - i); i < end; ++i)
+            f((char32_t)data[i]);
+        if (i >= size)
+            break;
+        char32_t codepoint;
+        i += decode_utf8_sequence(data + i, size - i, codepoint);
+        f(codepoint);
+    }
+}
+
+template <typename F>
+inline void for_each_codepoint(std::u16string_view str, F &&f) {
+    for (std::size_t i = 0; i < str.size(); ++i) {
+        char32_t c = str[i];
+        if (!is_surrogate(c)) {
+            f(c);
+        } else if (is_high_surrogate(c) && (i + 1 < str.size()) && is_low_surrogate(str[i + 1])) {
+            f(0x10000 + ((c - 0xd800) << 10) + (str[i + 1] - 0xdc00));
+            ++i;
+        } else { // Unpaired surrogate
+            f(ReplacementChar);
+        }
+    }
+}
+
+template <typename F>
+inline void for_each_codepoint(std::u32string_view str, F &&f) {
+    for (char32_t c: str)
+        f(c);
+}
+
+} // namespace cmw::unicode
@@ -18,5 +18,6 @@
 #pragma once
 
 #include "cmw/widgets/button.hpp"
+#include "cmw/widgets/cached_widget.hpp"
 #include "cmw/widgets/scene.hpp"
 #include "cmw/widgets/widget.hpp"
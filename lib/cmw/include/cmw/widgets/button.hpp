@@ -36,6 +36,12 @@ class Button: public Widget {
             return vertices[0].position <= position && position <= vertices[1].position;
         }
 
+        Areaf get_bounds() const override {
+            const auto &vertices = this->inner.get_mesh().get_vertices();
+            const auto &min = vertices[0].position, &max = vertices[1].position;
+            return {{min.x, min.y}, max.x - min.x, max.y - min.y};
+        }
+
         void on_draw(Renderer &renderer, float dt) override { }
 
         void on_hover(input::MouseMovedEvent &event) override {
@@ -0,0 +1,178 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include <glad/glad.h>
+
+#include "cmw/core/camera.hpp"
+#include "cmw/core/log.hpp"
+#include "cmw/core/renderer.hpp"
+#include "cmw/gl/framebuffer.hpp"
+#include "cmw/gl/texture.hpp"
+#include "cmw/utils/area.hpp"
+#include "cmw/utils/position.hpp"
+#include "cmw/widgets/widget.hpp"
+
+namespace cmw::widgets {
+
+// Draws its children once into a texture, then composites them as a single quad until one of them is invalidated
+// Children are drawn in scene coordinates, clipped to the area of the widget
+class CachedWidget: public Widget {
+    public:
+        CachedWidget(Widget *parent, const Areaf &area): Widget(parent), area(area), camera(make_camera(area)) { }
+
+        inline void set_area(const Areaf &area) {
+            this->area = area, this->camera = make_camera(area);
+            invalidate_bounds();
+        }
+
+        inline const Areaf &get_area() const { return this->area; }
+
+        inline gl::Texture2d &get_texture() { return this->texture; }
+
+        // The texture holds premultiplied colors, see Renderer::set_premultiplied
+        void draw(Renderer &renderer, float dt) override {
+            if (is_dirty() && !this->direct)
+                render(renderer, dt);
+
+            if (this->direct) {
+                for (auto i: get_draw_order())
+                    this->children[i]->draw(renderer, dt);
+            } else {
+                auto premultiplied = renderer.is_premultiplied();
+                renderer.set_premultiplied(true);
+                renderer.draw_texture(this->texture, {this->area.pos.x, this->area.pos.y, 0.0f},
+                    this->area.w, this->area.h);
+                renderer.set_premultiplied(premultiplied);
+            }
+            set_clean();
+        }
+
+        bool collides(const Position &position) const override {
+            return (this->area.pos.x <= position.x) && (position.x <= this->area.pos.x + this->area.w)
+                && (this->area.pos.y <= position.y) && (position.y <= this->area.pos.y + this->area.h);
+        }
+
+        Areaf get_bounds() const override {
+            return this->area;
+        }
+
+        void on_draw(Renderer &renderer, float dt) override { }
+
+        // Like the scene, pointer events only reach the topmost child under the cursor
+        void on_hover(input::MouseMovedEvent &event) override {
+            this->cursor = event.get_pos();
+            auto *child = find_child(this->cursor);
+            if ((child != this->hovered_child) && this->hovered_child)
+                this->hovered_child->on_leave();
+            this->hovered_child = child;
+            if (child)
+                child->on_hover(event);
+        }
+
+        void on_click(input::MouseButtonPressedEvent &event) override {
+            if (auto *child = find_child(this->cursor); child)
+                child->on_click(event);
+        }
+
+        void on_leave() override {
+            if (this->hovered_child)
+                std::exchange(this->hovered_child, nullptr)->on_leave();
+        }
+
+        void on_child_changed(Widget *child) override {
+            this->order_dirty = true;
+            if ((child == this->hovered_child)
+                    && (std::find(this->children.begin(), this->children.end(), child) == this->children.end()))
+                this->hovered_child = nullptr; // Removed
+            Widget::on_child_changed(child);
+        }
+
+    protected:
+        // Ties go to the child added last, which is drawn on top
+        inline Widget *find_child(const Position2f &pos) {
+            auto &order = get_draw_order();
+            for (auto it = order.rbegin(); it != order.rend(); ++it)
+                if (this->children[*it]->collides({pos.x, pos.y, 0.0f}))
+                    return this->children[*it];
+            return nullptr;
+        }
+
+        // Sorted again only after a child was added, removed or moved
+        inline const std::vector<std::uint32_t> &get_draw_order() {
+            if (this->order_dirty)
+                sort_children(this->draw_order), this->order_dirty = false;
+            return this->draw_order;
+        }
+
+        // Flipped vertically, to match the orientation draw_texture expects from loaded images
+        static inline OrthographicCamera make_camera(const Areaf &area) {
+            return {area.pos.x, area.pos.x + area.w, area.pos.y + area.h, area.pos.y, -10.0f, 10.0f};
+        }
+
+        void render(Renderer &renderer, float dt) {
+            GLsizei width = std::ceil(this->area.w), height = std::ceil(this->area.h);
+            if ((width <= 0) || (height <= 0))
+                return;
+
+            renderer.push_target(this->framebuffer, this->camera, width, height);
+
+            if ((width != this->width) || (height != this->height)) {
+                this->texture.bind();
+                this->texture.set_data(nullptr, width, height, GL_RGBA8, GL_RGBA);
+                this->texture.set_parameters(std::pair{GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE},
+                    std::pair{GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE},
+                    std::pair{GL_TEXTURE_MIN_FILTER, GL_LINEAR}, std::pair{GL_TEXTURE_MAG_FILTER, GL_LINEAR});
+                this->framebuffer.attach(this->texture);
+                this->width = width, this->height = height;
+
+                if (!this->framebuffer.is_complete()) {
+                    CMW_ERROR("Incomplete framebuffer (%#x), drawing children directly\n", this->framebuffer.get_status());
+                    this->direct = true;
+                    renderer.pop_target();
+                    return;
+                }
+            }
+
+            renderer.clear(GL_COLOR_BUFFER_BIT, {0.0f, 0.0f, 0.0f, 0.0f});
+            for (auto i: get_draw_order()) {
+                this->children[i]->draw(renderer, dt);
+                this->children[i]->set_clean();
+            }
+            renderer.pop_target();
+        }
+
+    protected:
+        Areaf area;
+        OrthographicCamera camera;
+        gl::Framebuffer framebuffer;
+        gl::Texture2d texture;
+        GLsizei width = 0, height = 0;
+        bool direct = false; // Set when the framebuffer can't be used
+        std::vector<std::uint32_t> draw_order;
+        bool order_dirty = true;
+        Position2f cursor; // Last hovered position, click events don't carry one
+        Widget *hovered_child = nullptr;
+};
+
+} // namespace cmw::widgets
@@ -17,8 +17,15 @@
 
 #pragma once
 
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
 #include "cmw/core/renderer.hpp"
+#include "cmw/utils/area.hpp"
 #include "cmw/utils/position.hpp"
+#include "cmw/utils/spatial_grid.hpp"
 #include "cmw/widgets/widget.hpp"
 #include "cmw/platform.h"
 
@@ -29,11 +36,11 @@ class Scene: public Widget {
         Scene(Position min, Position max): Widget(nullptr), min(min), max(max) {
             auto &im = Application::get_instance().get_window().get_input_manager();
 #ifdef CMW_SWITCH
-            im.register_callback<input::MouseMovedEvent>([this](auto &e) { this->on_hover(e); });
-            im.register_callback<input::MouseButtonPressedEvent>([this](auto &e) { this->on_click(e); });
+            this->pos_cb   = im.register_callback<input::MouseMovedEvent>([this](auto &e) { this->on_hover(e); });
+            this->click_cb = im.register_callback<input::MouseButtonPressedEvent>([this](auto &e) { this->on_click(e); });
 #else
-            im.register_callback<input::MouseMovedEvent>([this](auto &e) { this->on_hover(e); });
-            im.register_callback<input::MouseButtonPressedEvent>([this](auto &e) { this->on_click(e); });
+            this->pos_cb   = im.register_callback<input::MouseMovedEvent>([this](auto &e) { this->on_hover(e); });
+            this->click_cb = im.register_callback<input::MouseButtonPressedEvent>([this](auto &e) { this->on_click(e); });
 #endif
         }
 
@@ -43,40 +50,148 @@ class Scene: public Widget {
             im.remove_callback<input::MouseButtonPressedEvent>(this->click_cb);
         }
 
+        // Only dirty children are drawn again, the others replay the geometry recorded the last time they were
+        // Everything is drawn again after a glyph page eviction, since the recorded geometry may use freed pages
+        // Children are drawn by increasing z, in the order they are hit-tested
         void draw(Renderer &renderer, float dt) override {
-            for (auto &child: this->children)
-                child->draw(renderer, dt);
+            if (this->index_dirty)
+                rebuild_index();
+
+            this->invalidated.clear();
+            for (std::size_t i = this->children.size(); i < this->cache.size(); ++i) // Removed children
+                add_invalidated(this->cache[i].bounds);
+            this->cache.resize(this->children.size());
+            for (auto i: this->draw_order) {
+                auto *child = this->children[i];
+                auto &cached = this->cache[i];
+                if (child->is_dirty() || (cached.widget != child) || cached.list.is_stale()) {
+                    if (cached.widget)
+                        add_invalidated(cached.bounds);
+                    renderer.begin_capture(cached.list);
+                    child->draw(renderer, dt);
+                    renderer.end_capture();
+                    child->set_clean();
+                    cached.widget = child, cached.bounds = child->get_bounds();
+                    add_invalidated(cached.bounds);
+                }
+                renderer.submit(cached.list);
+            }
+            this->set_clean();
         }
 
+        // Areas that changed since the previous draw, for consumers that only redraw part of the target
+        // Children without bounds invalidate the whole scene
+        inline const std::vector<Areaf> &get_invalidated_rects() const { return this->invalidated; }
+
         bool collides(const Position &position) const override {
             return this->min <= position && position <= this->max;
         }
 
+        Areaf get_bounds() const override {
+            return {{this->min.x, this->min.y}, this->max.x - this->min.x, this->max.y - this->min.y};
+        }
+
         void on_draw(Renderer &renderer, float dt) override { }
 
+        // Pointer events only reach the topmost child under the cursor, found through a grid of the child bounds
+        // The previously hovered child is notified when the pointer moves off it
         void on_hover(input::MouseMovedEvent &event) override {
             CMW_TRACE("x: %.3f, y: %.3f\n", event.get_x(), event.get_y());
-            if (!collides({event.get_x(), event.get_y(), 0.0f})){
-                this->hovered = false;
-                return;
-            }
-            this->hovered = true;
-            for (auto &child: this->children)
+            this->cursor  = event.get_pos();
+            this->hovered = collides({event.get_x(), event.get_y(), 0.0f});
+
+            auto *child = this->hovered ? find_child(event.get_pos()) : nullptr;
+            if ((child != this->hovered_child) && this->hovered_child)
+                this->hovered_child->on_leave();
+            this->hovered_child = child;
+            if (child)
                 child->on_hover(event);
         }
 
+        void on_leave() override {
+            if (this->hovered_child)
+                std::exchange(this->hovered_child, nullptr)->on_leave();
+            this->hovered = false;
+        }
+
         void on_click(input::MouseButtonPressedEvent &event) override {
             if (!this->hovered)
                 return;
-            for (auto &child: this->children)
+            if (auto *child = find_child(this->cursor); child)
                 child->on_click(event);
         }
 
+        void on_child_changed(Widget *child) override {
+            this->index_dirty = true;
+            if ((child == this->hovered_child)
+                    && (std::find(this->children.begin(), this->children.end(), child) == this->children.end()))
+                this->hovered_child = nullptr; // Removed
+        }
+
+        Widget *find_child(const Position2f &pos) {
+            if (this->index_dirty)
+                rebuild_index();
+
+            Widget *top = nullptr;
+            std::uint32_t top_idx = 0;
+            auto test = [&](std::uint32_t idx) {
+                auto *child = this->children[idx];
+                if ((top && ((child->get_z() < top->get_z()) || ((child->get_z() == top->get_z()) && (idx < top_idx))))
+                        || !child->collides({pos.x, pos.y, 0.0f}))
+                    return;
+                top = child, top_idx = idx;
+            };
+            this->grid.query(pos, test);
+            for (auto idx: this->unbounded)
+                test(idx);
+            return top;
+        }
+
+        inline void set_cell_size(float size) { this->cell_size = size; this->index_dirty = true; }
+
     protected:
-        bool hovered;
+        struct CachedChild {
+            Widget *widget = nullptr;
+            Areaf bounds;
+            Renderer::DrawList list;
+        };
+
+        inline void add_invalidated(const Areaf &bounds) {
+            if ((bounds.w > 0.0f) && (bounds.h > 0.0f))
+                this->invalidated.push_back(bounds);
+            else
+                this->invalidated.push_back(get_bounds());
+        }
+
+        void rebuild_index() {
+            this->grid.reset({this->min.x, this->min.y}, {this->max.x, this->max.y}, this->cell_size);
+            this->unbounded.clear();
+            for (std::uint32_t i = 0; i < this->children.size(); ++i) {
+                auto bounds = this->children[i]->get_bounds();
+                if ((bounds.w > 0.0f) && (bounds.h > 0.0f))
+                    this->grid.insert(i, bounds);
+                else
+                    this->unbounded.push_back(i);
+            }
+            sort_children(this->draw_order);
+            this->index_dirty = false;
+        }
+
+    protected:
+        bool hovered = false;
         Position min, max;
+        Position2f cursor; // Last hovered position, click events don't carry one
+        Widget *hovered_child = nullptr;
         std::size_t pos_cb, click_cb;
-};
 
+        SpatialGrid grid;
+        std::vector<std::uint32_t> unbounded; // Children without bounds, always tested
+        std::vector<std::uint32_t> draw_order;
+        float cell_size = 64.0f;
+        bool index_dirty = true;
+
+        std::vector<CachedChild> cache; // Geometry recorded per child, in the same order
+        std::vector<Areaf> invalidated;
+};
 
 } // namespace cmw::widgets
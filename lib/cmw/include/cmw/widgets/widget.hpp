@@ -17,9 +17,13 @@
 
 #pragma once
 
+#include <cstdint>
+#include <algorithm>
+#include <numeric>
 #include <vector>
 
 #include "cmw/core/input.hpp"
+#include "cmw/utils/area.hpp"
 #include "cmw/utils/position.hpp"
 
 namespace cmw {
@@ -35,9 +39,55 @@ class Widget {
                 parent->add_child(this);
         }
 
-        virtual ~Widget() = default;
+        virtual ~Widget() {
+            if (this->parent)
+                this->parent->remove_child(this);
+            for (auto *child: this->children)
+                child->parent = nullptr;
+        }
+
+        inline void add_child(Widget *child) {
+            this->children.push_back(child);
+            invalidate();
+            on_child_changed(child);
+        }
+
+        inline void remove_child(Widget *child) {
+            this->children.erase(std::remove(this->children.begin(), this->children.end(), child), this->children.end());
+            invalidate();
+            on_child_changed(child);
+        }
 
-        inline void add_child(Widget *child) { this->children.push_back(child); }
+        // Bounds in scene coordinates, used by the scene to find the widgets under the pointer
+        // Empty bounds mean the widget is always hit-tested with collides
+        virtual Areaf get_bounds() const { return {}; }
+
+        // Widgets with a higher z are drawn and hit on top, ties go to the last child added
+        inline float get_z() const { return this->z; }
+        inline void set_z(float z) { this->z = z; invalidate_bounds(); }
+
+        // Must be called when the bounds change
+        inline void invalidate_bounds() {
+            invalidate();
+            if (this->parent)
+                this->parent->on_child_changed(this);
+        }
+
+        // Must be called when the widget looks different, so that its cached geometry is rebuilt
+        // Marks the ancestors as well, so that a clean widget has a clean subtree
+        inline void invalidate() {
+            for (auto *widget = this; widget; widget = widget->parent)
+                widget->dirty = true;
+        }
+
+        inline bool is_dirty() const { return this->dirty; }
+        inline void set_clean() { this->dirty = false; }
+
+        // Called when a child is added, removed, or changes its bounds. Forwarded to the parent by default
+        virtual void on_child_changed(Widget *child) {
+            if (this->parent)
+                this->parent->on_child_changed(this);
+        }
 
         virtual void draw(Renderer &renderer, float dt) = 0;
 
@@ -47,9 +97,24 @@ class Widget {
         virtual void on_hover(input::MouseMovedEvent &event) = 0;
         virtual void on_click(input::MouseButtonPressedEvent &event) = 0;
 
+        // Called when the pointer moves off the widget, after it was hovered
+        virtual void on_leave() { }
+
+    protected:
+        // Indices of the children from bottom to top, by increasing z with ties in insertion order, as hit-tested
+        inline void sort_children(std::vector<std::uint32_t> &order) const {
+            order.resize(this->children.size());
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [this](std::uint32_t lhs, std::uint32_t rhs) {
+                return this->children[lhs]->get_z() < this->children[rhs]->get_z();
+            });
+        }
+
     protected:
         Widget *parent;
         std::vector<Widget *> children;
+        float z = 0.0f;
+        bool dirty = true;
 };
 
 } // namespace widgets
@@ -0,0 +1,129 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+#include "cmw/core/log.hpp"
+#include "cmw/core/animation.hpp"
+
+namespace cmw {
+
+AnimationSystem::Track AnimationSystem::add(const TrackInfo &info) {
+    CMW_TRY_THROW(info.duration > 0.0f, std::invalid_argument("Animation duration must be positive"));
+    CMW_TRY_THROW((info.easing != Easing::Custom) || info.curve, std::invalid_argument("Custom easing without a curve"));
+
+    Track track;
+    if (!this->free_tracks.empty()) {
+        track = this->free_tracks.back();
+        this->free_tracks.pop_back();
+    } else {
+        track = this->slots.size();
+        this->slots.push_back(Invalid);
+    }
+
+    this->slots[track] = this->tracks.size();
+    this->tracks.push_back(track);
+    this->starts.push_back(get_relative_time() + info.delay);
+    this->inv_durations.push_back(1.0f / info.duration);
+    this->easings.push_back(info.easing);
+    this->loops.push_back(info.loop);
+    this->curves.push_back(info.curve);
+    this->froms.push_back(info.from);
+    this->tos.push_back(info.to);
+    this->progress.push_back(0.0f);
+    this->factors.push_back(0.0f);
+    this->matrices.emplace_back(1.0f);
+    return track;
+}
+
+void AnimationSystem::remove(Track track) {
+    CMW_TRY_THROW(contains(track), std::invalid_argument("Invalid animation track"));
+
+    // Order doesn't matter, move the last track in the hole
+    auto slot = this->slots[track], last = (std::uint32_t)this->tracks.size() - 1;
+    auto move_last = [slot, last](auto &vec) {
+        vec[slot] = vec[last];
+        vec.pop_back();
+    };
+    move_last(this->tracks), move_last(this->starts), move_last(this->inv_durations);
+    move_last(this->easings), move_last(this->loops), move_last(this->curves);
+    move_last(this->froms), move_last(this->tos);
+    move_last(this->progress), move_last(this->factors), move_last(this->matrices);
+
+    if (slot != last)
+        this->slots[this->tracks[slot]] = slot;
+    this->slots[track] = Invalid;
+    this->free_tracks.push_back(track);
+}
+
+void AnimationSystem::restart(Track track, float delay) {
+    this->starts[this->slots[track]] = get_relative_time() + delay;
+}
+
+void AnimationSystem::update(double time) {
+    if (!this->started)
+        this->epoch = time, this->started = true;
+    this->time = time;
+
+    auto now = get_relative_time();
+    auto nb = this->tracks.size();
+
+    // Raw progress, vectorizable
+    const float *starts = this->starts.data(), *inv_durations = this->inv_durations.data();
+    float *progress = this->progress.data();
+    for (std::size_t i = 0; i < nb; ++i)
+        progress[i] = (now - starts[i]) * inv_durations[i];
+
+    // Looping and easing
+    float *factors = this->factors.data();
+    for (std::size_t i = 0; i < nb; ++i) {
+        float t = std::max(progress[i], 0.0f);
+        switch (this->loops[i]) {
+            case Loop::Once:
+                t = std::min(t, 1.0f);
+                break;
+            case Loop::Repeat:
+                t -= std::floor(t);
+                break;
+            case Loop::PingPong:
+                t = 1.0f - std::abs(std::fmod(t, 2.0f) - 1.0f);
+                break;
+        }
+        factors[i] = (this->easings[i] == Easing::Custom) ? this->curves[i](t) : ease(this->easings[i], t);
+    }
+
+    // Interpolation, composing translation * rotation around z * scale directly
+    for (std::size_t i = 0; i < nb; ++i) {
+        const auto &from = this->froms[i], &to = this->tos[i];
+        float f = factors[i];
+        auto translation = from.translation + (to.translation - from.translation) * f;
+        auto scale       = from.scale       + (to.scale       - from.scale)       * f;
+        float rotation   = from.rotation    + (to.rotation    - from.rotation)    * f;
+        float c = std::cos(rotation), s = std::sin(rotation);
+
+        auto &m = this->matrices[i];
+        m[0] = glm::vec4( c * scale.x, s * scale.x, 0.0f,    0.0f);
+        m[1] = glm::vec4(-s * scale.y, c * scale.y, 0.0f,    0.0f);
+        m[2] = glm::vec4( 0.0f,        0.0f,        scale.z, 0.0f);
+        m[3] = glm::vec4(translation, 1.0f);
+    }
+}
+
+} // namespace cmw
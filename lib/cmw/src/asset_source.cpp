@@ -0,0 +1,116 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include <sys/stat.h>
+
+#include "cmw/core/log.hpp"
+#include "cmw/utils/lz4.hpp"
+#include "cmw/utils/mapped_file.hpp"
+
+#include "cmw/core/asset_source.hpp"
+
+namespace cmw {
+
+AssetView DirectorySource::open(const std::string &path) const {
+    return AssetView(MappedFile(this->root + path));
+}
+
+bool DirectorySource::contains(const std::string &path) const {
+    struct stat st;
+    return !stat((this->root + path).c_str(), &st) && S_ISREG(st.st_mode);
+}
+
+bool ArchiveSource::load(const std::string &path) {
+    this->header = nullptr, this->entries = nullptr, this->names = nullptr;
+    if (!this->file.open(path))
+        return false;
+
+    auto *hdr = reinterpret_cast<const Header *>(this->file.data());
+    // Offsets are untrusted, bounds are checked in a form that can't wrap around
+    auto size = this->file.size();
+    auto index_end = [hdr]() { return sizeof(Header) + (std::uint64_t)hdr->nb_entries * sizeof(Entry); };
+    if ((size < sizeof(Header)) || (hdr->magic != magic) || (hdr->version != version)
+            || (size < index_end()) || (hdr->names_offset < index_end())
+            || (hdr->names_size > size) || (hdr->names_offset > size - hdr->names_size)) {
+        CMW_ERROR("Invalid asset archive %s\n", path.c_str());
+        this->file.close();
+        return false;
+    }
+
+    this->header  = hdr;
+    this->entries = reinterpret_cast<const Entry *>(hdr + 1);
+    this->names   = reinterpret_cast<const char *>(this->file.data() + hdr->names_offset);
+    CMW_TRACE("Loaded asset archive %s (%u entries)\n", path.c_str(), hdr->nb_entries);
+    return true;
+}
+
+const ArchiveSource::Entry *ArchiveSource::find(const std::string &path) const {
+    if (!this->header)
+        return nullptr;
+
+    auto hash = hash_path(path);
+    auto *end = this->entries + this->header->nb_entries;
+    auto *it  = std::lower_bound(this->entries, end, hash, [](const Entry &e, std::uint64_t h) { return e.hash < h; });
+    for (; (it != end) && (it->hash == hash); ++it) { // Names disambiguate hash collisions
+        if ((it->name_size <= this->header->names_size)
+                && (it->name_offset <= this->header->names_size - it->name_size)
+                && (path.compare(0, path.npos, this->names + it->name_offset, it->name_size) == 0))
+            return it;
+    }
+    return nullptr;
+}
+
+AssetView ArchiveSource::open(const std::string &path) const {
+    auto *entry = find(path);
+    if (!entry)
+        return {};
+
+    if ((entry->size > this->file.size()) || (entry->offset > this->file.size() - entry->size)) {
+        CMW_ERROR("Archive entry %s is out of bounds\n", path.c_str());
+        return {};
+    }
+
+    auto *data = this->file.data() + entry->offset;
+    switch (entry->compression) {
+        case Compression::None:
+            return AssetView(data, entry->size);
+        case Compression::Lz4: {
+            if (entry->original_size > lz4::decompress_bound(entry->size)) {
+                CMW_ERROR("Archive entry %s has an invalid size\n", path.c_str());
+                return {};
+            }
+            std::vector<std::uint8_t> buffer(entry->original_size);
+            if (!lz4::decompress(data, entry->size, buffer.data(), buffer.size())) {
+                CMW_ERROR("Failed to decompress %s\n", path.c_str());
+                return {};
+            }
+            return AssetView(std::move(buffer));
+        }
+        default:
+            CMW_ERROR("Unsupported compression %u for %s\n", (unsigned int)entry->compression, path.c_str());
+            return {};
+    }
+}
+
+bool ArchiveSource::contains(const std::string &path) const {
+    return find(path) != nullptr;
+}
+
+} // namespace cmw
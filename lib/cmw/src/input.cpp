@@ -15,21 +15,25 @@
 // You should have received a copy of the GNU General Public License
 // along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <cstdio>
 #include <cstdint>
 #include <limits>
+#include <type_traits>
 #include <utility>
+#include <variant>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
-#include "cmw/core/application.hpp"
 #include "cmw/core/input.hpp"
 #include "cmw/core/window.hpp"
+#include "cmw/utils/scope_guard.hpp"
 #include "cmw/utils/position.hpp"
 #include "cmw/platform.h"
 
 namespace cmw::input {
 
 void InputManager::set_window(GLFWwindow *window) {
+    glfwGetWindowSize(window, &this->window_size.w, &this->window_size.h);
     glfwSetKeyCallback(window, keys_cb);
     glfwSetCursorPosCallback(window, cursor_cb);
     glfwSetMouseButtonCallback(window, click_cb);
@@ -43,18 +47,166 @@ void InputManager::set_window(GLFWwindow *window) {
 #endif
 }
 
+std::size_t InputManager::process_events() {
+    std::swap(this->motion_history, this->raw_motion);
+    this->raw_motion.clear();
+
+    // Window events are ignored while replaying
+    if (is_replaying()) {
+        this->queue_size = 0;
+        for (; is_replaying() && (this->replay_log[this->replay_pos].frame == this->frame); ++this->replay_pos)
+            push(decode(this->replay_log[this->replay_pos]));
+        if (!is_replaying())
+            CMW_INFO("Input replay finished\n");
+    }
+
+    // Events pushed by the callbacks are dispatched during this call
+    std::size_t nb_events = 0;
+    for (; this->queue_size; ++nb_events)
+        dispatch(pop());
+    ++this->frame;
+    return nb_events;
+}
+
+void InputManager::dispatch(AnyEvent &&event) {
+    if (this->record_fp) {
+        auto record = encode(event);
+        record.frame = this->frame, record.time = glfwGetTime() - this->record_start;
+        std::fwrite(&record, sizeof(record), 1, this->record_fp);
+    }
+
+    std::visit([this](auto &e) {
+        if constexpr (!std::is_same_v<std::decay_t<decltype(e)>, std::monostate>)
+            dispatch(e);
+    }, event);
+}
+
+bool InputManager::start_recording(const std::string &path) {
+    stop_recording();
+    if (!(this->record_fp = std::fopen(path.c_str(), "wb"))) {
+        CMW_ERROR("Failed to open %s\n", path.c_str());
+        return false;
+    }
+    LogHeader hdr = {log_magic, log_version};
+    std::fwrite(&hdr, sizeof(hdr), 1, this->record_fp);
+    this->frame = 0, this->record_start = glfwGetTime();
+    CMW_INFO("Recording input to %s\n", path.c_str());
+    return true;
+}
+
+void InputManager::stop_recording() {
+    if (this->record_fp)
+        std::fclose(std::exchange(this->record_fp, nullptr));
+}
+
+bool InputManager::start_replay(const std::string &path) {
+    stop_replay();
+    std::FILE *fp = std::fopen(path.c_str(), "rb");
+    if (!fp) {
+        CMW_ERROR("Failed to open %s\n", path.c_str());
+        return false;
+    }
+    CMW_SCOPE_GUARD([fp]() { std::fclose(fp); });
+
+    LogHeader hdr;
+    if ((std::fread(&hdr, sizeof(hdr), 1, fp) != 1) || (hdr.magic != log_magic) || (hdr.version != log_version)) {
+        CMW_ERROR("%s is not an input log\n", path.c_str());
+        return false;
+    }
+
+    // Keys and buttons index the repeat counters of the events, check them before any event is built
+    auto is_valid = [](const EventRecord &record) {
+        switch (record.type) {
+            case EventType::KeyPressed:
+            case EventType::KeyHeld:
+            case EventType::KeyReleased:
+                return (record.a >= 0) && (record.a < Keys::KeyLast);
+            case EventType::MouseButtonPressed:
+            case EventType::MouseButtonHeld:
+            case EventType::MouseButtonReleased:
+                return (record.a >= 0) && (record.a < MouseButtons::Last);
+            default:
+                return (record.type > EventType::Invalid) && (record.type < EventType::Max);
+        }
+    };
+
+    EventRecord record;
+    while (std::fread(&record, sizeof(record), 1, fp) == 1) {
+        if (!is_valid(record)) {
+            CMW_ERROR("Invalid event in %s, truncating the replay\n", path.c_str());
+            break;
+        }
+        // Events are consumed when their frame comes up, an earlier frame would stall the replay
+        if (!this->replay_log.empty() && (record.frame < this->replay_log.back().frame)) {
+            CMW_ERROR("Out of order events in %s\n", path.c_str());
+            this->replay_log.clear();
+            return false;
+        }
+        this->replay_log.push_back(record);
+    }
+    this->frame = 0;
+    CMW_INFO("Replaying %zu input events from %s\n", this->replay_log.size(), path.c_str());
+    return true;
+}
+
+InputManager::EventRecord InputManager::encode(const AnyEvent &event) {
+    EventRecord record = {};
+    std::visit([&record](const auto &e) {
+        using Type = std::decay_t<decltype(e)>;
+        if constexpr (std::is_same_v<Type, std::monostate>) {
+            return;
+        } else {
+            record.type = Type::get_static_type();
+            if constexpr (std::is_base_of_v<KeyEvent, Type>)
+                record.a = e.get_key(), record.b = e.get_mods();
+            else if constexpr (std::is_same_v<Type, CharTypedEvent>)
+                record.a = e.get_codepoint();
+            else if constexpr (std::is_base_of_v<MouseEvent, Type>)
+                record.x = e.get_x(), record.y = e.get_y();
+            else if constexpr (std::is_same_v<Type, WindowResizedEvent>)
+                record.a = e.get_w(), record.b = e.get_h();
+            else if constexpr (std::is_same_v<Type, WindowMovedEvent>)
+                record.a = e.get_x(), record.b = e.get_y();
+            else if constexpr (std::is_same_v<Type, JoystickMovedEvent>)
+                record.a = e.is_left(), record.x = e.get_x(), record.y = e.get_y();
+        }
+    }, event);
+    return record;
+}
+
+AnyEvent InputManager::decode(const EventRecord &record) {
+    switch (record.type) {
+        case EventType::KeyPressed:          return KeyPressedEvent(record.a, record.b);
+        case EventType::KeyHeld:             return KeyHeldEvent(record.a, record.b);
+        case EventType::KeyReleased:         return KeyReleasedEvent(record.a, record.b);
+        case EventType::CharTyped:           return CharTypedEvent(record.a);
+        case EventType::MouseButtonPressed:  return MouseButtonPressedEvent(record.a, record.b);
+        case EventType::MouseButtonHeld:     return MouseButtonHeldEvent(record.a, record.b);
+        case EventType::MouseButtonReleased: return MouseButtonReleasedEvent(record.a, record.b);
+        case EventType::MouseMoved:          return MouseMovedEvent(record.x, record.y);
+        case EventType::MouseScrolled:       return MouseScrolledEvent(record.x, record.y);
+        case EventType::WindowResized:       return WindowResizedEvent(record.a, record.b);
+        case EventType::WindowMoved:         return WindowMovedEvent(record.a, record.b);
+        case EventType::WindowFocused:       return WindowFocusedEvent();
+        case EventType::WindowDefocused:     return WindowDefocusedEvent();
+        case EventType::WindowClosed:        return WindowClosedEvent();
+        case EventType::JoystickMoved:       return JoystickMovedEvent(record.x, record.y, record.a);
+        default:                             return {};
+    }
+}
+
 #ifdef CMW_SWITCH
-void InputManager::process_nx_events(GLFWwindow *window) const {
+void InputManager::process_nx_events(GLFWwindow *window) {
     // Joysticks
     constexpr float joystick_max = (float)std::numeric_limits<std::int16_t>::max();
     {
         JoystickPosition pos;
         hidJoystickRead(&pos, CONTROLLER_P1_AUTO, JOYSTICK_LEFT);
         if ((pos.dx + pos.dy) != 0)
-            this->process(JoystickMovedEvent((float)pos.dx / joystick_max, (float)pos.dy / joystick_max, 1));
+            this->push(JoystickMovedEvent((float)pos.dx / joystick_max, (float)pos.dy / joystick_max, 1));
         hidJoystickRead(&pos, CONTROLLER_P1_AUTO, JOYSTICK_RIGHT);
         if ((pos.dx + pos.dy) != 0)
-            this->process(JoystickMovedEvent((float)pos.dx / joystick_max, (float)pos.dy / joystick_max, 0));
+            this->push(JoystickMovedEvent((float)pos.dx / joystick_max, (float)pos.dy / joystick_max, 0));
     }
 }
 #endif
@@ -62,60 +214,63 @@ void InputManager::process_nx_events(GLFWwindow *window) const {
 void InputManager::keys_cb(GLFWwindow *window, int key, int scancode, int action, int modifiers) {
     InputManager &tmp_this = ((Window *)glfwGetWindowUserPointer(window))->get_input_manager();
     if (action == GLFW_PRESS)
-        tmp_this.process(KeyPressedEvent(key, modifiers));
+        tmp_this.push(KeyPressedEvent(key, modifiers));
     else if (action == GLFW_RELEASE)
-        tmp_this.process(KeyReleasedEvent(key, modifiers));
+        tmp_this.push(KeyReleasedEvent(key, modifiers));
     else
-        tmp_this.process(KeyHeldEvent(key, modifiers));
+        tmp_this.push(KeyHeldEvent(key, modifiers));
 }
 
 void InputManager::char_cb(GLFWwindow *window, unsigned int codepoint) {
     InputManager &tmp_this = ((Window *)glfwGetWindowUserPointer(window))->get_input_manager();
-    tmp_this.process(CharTypedEvent(codepoint));
+    tmp_this.push(CharTypedEvent(codepoint));
 }
 
 void InputManager::cursor_cb(GLFWwindow *window, double x, double y) {
-    auto [w, h] = Application::get_instance().get_window().get_size();
     InputManager &tmp_this = ((Window *)glfwGetWindowUserPointer(window))->get_input_manager();
-    tmp_this.process(MouseMovedEvent(x, h - y));
+    float flipped_y = tmp_this.window_size.h - y;
+    if (tmp_this.keep_motion_history)
+        tmp_this.raw_motion.push_back({{(float)x, flipped_y}, glfwGetTime()});
+    tmp_this.push(MouseMovedEvent(x, flipped_y));
 }
 
 void InputManager::scroll_cb(GLFWwindow *window, double x, double y) {
     InputManager &tmp_this = ((Window *)glfwGetWindowUserPointer(window))->get_input_manager();
-    tmp_this.process(MouseScrolledEvent(x, y));
+    tmp_this.push(MouseScrolledEvent(x, y));
 }
 
 void InputManager::click_cb(GLFWwindow *window, int key, int action, int modifiers) {
     InputManager &tmp_this = ((Window *)glfwGetWindowUserPointer(window))->get_input_manager();
     if (action == GLFW_PRESS)
-        tmp_this.process(MouseButtonPressedEvent(key, modifiers));
+        tmp_this.push(MouseButtonPressedEvent(key, modifiers));
     else if (action == GLFW_RELEASE)
-        tmp_this.process(MouseButtonReleasedEvent(key, modifiers));
+        tmp_this.push(MouseButtonReleasedEvent(key, modifiers));
     else
-        tmp_this.process(MouseButtonHeldEvent(key, modifiers));
+        tmp_this.push(MouseButtonHeldEvent(key, modifiers));
 }
 
 void InputManager::window_pos_cb(GLFWwindow* window, int x, int y) {
     InputManager &tmp_this = ((Window *)glfwGetWindowUserPointer(window))->get_input_manager();
-    tmp_this.process(WindowMovedEvent(x, y));
+    tmp_this.push(WindowMovedEvent(x, y));
 }
 
 void InputManager::window_size_cb(GLFWwindow* window, int width, int height) {
     InputManager &tmp_this = ((Window *)glfwGetWindowUserPointer(window))->get_input_manager();
-    tmp_this.process(WindowResizedEvent(width, height));
+    tmp_this.window_size = {width, height};
+    tmp_this.push(WindowResizedEvent(width, height));
 }
 
 void InputManager::window_focus_cb(GLFWwindow* window, int focused) {
     InputManager &tmp_this = ((Window *)glfwGetWindowUserPointer(window))->get_input_manager();
     if (focused)
-        tmp_this.process(WindowFocusedEvent());
+        tmp_this.push(WindowFocusedEvent());
     else
-        tmp_this.process(WindowDefocusedEvent());
+        tmp_this.push(WindowDefocusedEvent());
 }
 
 void InputManager::window_close_cb(GLFWwindow* window) {
     InputManager &tmp_this = ((Window *)glfwGetWindowUserPointer(window))->get_input_manager();
-    tmp_this.process(WindowClosedEvent());
+    tmp_this.push(WindowClosedEvent());
 }
 
 } // namespace cmw::input
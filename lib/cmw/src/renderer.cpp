@@ -16,14 +16,23 @@
 // along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <cstdint>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
 #include <glad/glad.h>
 
+#include "cmw/core/log.hpp"
 #include "cmw/core/mesh.hpp"
 #include "cmw/core/text.hpp"
+#include "cmw/core/text_batch.hpp"
+#include "cmw/gl/extensions.hpp"
+#include "cmw/gl/framebuffer.hpp"
 #include "cmw/gl/shader_program.hpp"
 #include "cmw/gl/texture.hpp"
 #include "cmw/utils/color.hpp"
 #include "cmw/utils/position.hpp"
+#include "cmw/utils/unicode.hpp"
 
 #include "cmw/core/renderer.hpp"
 
@@ -48,11 +57,44 @@ Renderer::Renderer(ResourceManager &resource_man): resource_man(resource_man),
         gl::BufferElement::Float4,
         gl::BufferElement::Int,
         gl::BufferElement::Uint, // Ubyte padded to 4 bytes
+        gl::BufferElement::Int,
     });
     this->vbo.set_data(nullptr, sizeof(Vertex) * this->max_vertices, GL_DYNAMIC_DRAW);
     this->ebo.set_data(nullptr, sizeof(Index)  * this->max_indices,  GL_DYNAMIC_DRAW);
 
     this->textures.reserve(this->max_textures);
+    this->texture_arrays.reserve(this->max_texture_arrays);
+
+    set_texture_array_units(this->mesh_program);
+}
+
+void Renderer::set_texture_array_units(gl::ShaderProgram &program) const {
+    // Always set, since samplers of different types can't share a unit even when unused
+    program.bind();
+    for (std::size_t i = 0; i < this->max_texture_arrays; ++i)
+        program.set_value("u_texture_arrays[" + std::to_string(i) + "]", (int)(this->max_textures + i));
+}
+
+bool Renderer::set_bindless(bool enable) {
+    if (enable && !gl::ext::bindless_texture) {
+        CMW_WARN("Bindless textures are unsupported, falling back to texture units\n");
+        enable = false;
+    }
+
+    if (enable && !this->bindless_program) {
+        try {
+            this->bindless_program = &this->resource_man.get_shader("shaders/mesh.vert", "shaders/mesh_bindless.frag");
+            set_texture_array_units(*this->bindless_program);
+        } catch (const std::runtime_error &e) {
+            CMW_WARN("Failed to build the bindless shader (%s), falling back to texture units\n", e.what());
+            enable = false;
+        }
+    }
+
+    if (this->cur_program == &get_default_mesh_shader())
+        this->cur_program = enable ? this->bindless_program : &this->mesh_program;
+    this->bindless = enable;
+    return enable;
 }
 
 void Renderer::end() {
@@ -60,11 +102,29 @@ void Renderer::end() {
     this->vbo.set_sub_data(this->vertex_buffer.data(), this->vertex_buffer.size() * sizeof(Vertex));
     this->ebo.set_sub_data(this->index_buffer.data(),  this->index_buffer.size()  * sizeof(Index));
 
+    if (uses_bindless()) {
+        this->handle_buffer.bind();
+        this->handle_buffer.set_data(this->texture_handles.data(), this->texture_handles.size() * sizeof(GLuint64),
+            GL_STREAM_DRAW);
+        this->handle_buffer.bind_base(0);
+    }
+
     for (std::size_t i = 0; i < this->textures.size(); ++i) {
-        this->mesh_program.set_value("u_textures[" + std::to_string(i) + "]", (int)i);
+        this->cur_program->set_value("u_textures[" + std::to_string(i) + "]", (int)i);
         gl::Texture2d::active(i);
         this->textures[i]->bind();
     }
+    for (std::size_t i = 0; i < this->texture_arrays.size(); ++i) {
+        gl::Texture2dArray::active(this->max_textures + i);
+        this->texture_arrays[i]->bind();
+    }
+
+    if (this->premultiplied)
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    else if (!this->targets.empty()) // Keep the result premultiplied, so that it composites correctly
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    else
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     this->cur_program->set_value("u_view_proj", *this->view_proj);
     glDrawElements(this->cur_mode, this->index_buffer.size(), GL_UNSIGNED_INT, 0);
@@ -72,116 +132,290 @@ void Renderer::end() {
     this->vertex_buffer.clear();
     this->index_buffer.clear();
     this->textures.clear();
+    this->texture_arrays.clear();
+    if (!this->texture_handles.empty()) {
+        this->texture_handles.clear();
+        this->texture_indices.clear();
+    }
+}
+
+void Renderer::push_target(gl::Framebuffer &framebuffer, const glm::mat4 &view_proj, GLsizei width, GLsizei height) {
+    if (!this->index_buffer.empty())
+        end();
+
+    auto &target = this->targets.emplace_back();
+    target.framebuffer = gl::Framebuffer::get_bound();
+    glGetIntegerv(GL_VIEWPORT, target.viewport);
+    target.view_proj = this->view_proj, target.program = this->cur_program, target.mode = this->cur_mode;
+    target.capture = std::exchange(this->capture, nullptr);
+    target.premultiplied = std::exchange(this->premultiplied, false);
+
+    framebuffer.bind();
+    glViewport(0, 0, width, height);
+    this->view_proj   = &view_proj;
+    this->cur_program = &get_default_mesh_shader();
+    this->cur_mode    = GL_TRIANGLES;
+}
+
+void Renderer::pop_target() {
+    CMW_TRY_THROW(!this->targets.empty(), std::logic_error("No render target to pop"));
+    if (!this->index_buffer.empty())
+        end();
+
+    auto &target = this->targets.back();
+    gl::Framebuffer::bind(target.framebuffer);
+    glViewport(target.viewport[0], target.viewport[1], target.viewport[2], target.viewport[3]);
+    this->view_proj = target.view_proj, this->cur_program = target.program, this->cur_mode = target.mode;
+    this->capture = target.capture, this->premultiplied = target.premultiplied;
+    this->targets.pop_back();
+}
+
+void Renderer::set_premultiplied(bool premultiplied) {
+    if (premultiplied == this->premultiplied)
+        return;
+    if (!this->capture && !this->index_buffer.empty()) // The blend function is set when flushing
+        end();
+    this->premultiplied = premultiplied;
 }
 
 void Renderer::add_mesh(Mesh &mesh, const glm::mat4 &model, RenderingMode mode) {
-    if ((this->textures.size() >= this->max_textures)
+    if (!this->capture && ((this->textures.size() >= this->max_textures)
             || (this->vertex_buffer.size() >= this->max_vertices)
-            || (this->index_buffer.size() >= this->max_indices)) { // Flush collected draw data
+            || (this->index_buffer.size() >= this->max_indices))) { // Flush collected draw data
         // CMW_INFO("Resource exhaustion triggered draw event\n");
         end(); // Don't need to use begin() as the same values are kept for the rest of the operation
     }
 
-    int tex_idx;
-    auto it = std::find(this->textures.begin(), this->textures.end(), &mesh.get_texture());
-    if (it != this->textures.end()) {
-        tex_idx = it - this->textures.begin();
-    } else {
-        this->textures.push_back(&mesh.get_texture());
-        tex_idx = this->textures.size() - 1;
-    }
+    int tex_idx = get_texture_idx(mesh.get_texture());
 
     const auto &vertices = mesh.get_vertices();
     const auto &indices  = mesh.get_indices();
-    auto vbo_sz = this->vertex_buffer.size();
-    auto ebo_sz = this->index_buffer.size();
+    auto &vertex_out = get_vertex_target();
+    auto &index_out  = get_index_target();
+    auto vbo_sz = vertex_out.size();
+    auto ebo_sz = index_out.size();
+    auto base = this->capture ? 0 : vbo_sz; // Captured indices are relative to their range
 
-    this->index_buffer.reserve(ebo_sz + indices.size());
+    index_out.reserve(ebo_sz + indices.size());
     for (const auto &index: indices)
-        this->index_buffer.emplace_back(vbo_sz + index);
+        index_out.emplace_back(base + index);
 
-    this->vertex_buffer.reserve(vbo_sz + vertices.size());
+    vertex_out.reserve(vbo_sz + vertices.size());
     for (const auto &vertex: vertices) {
         glm::vec3 position = glm::vec3(model * glm::vec4((glm::vec3)vertex.position, 1.0f)); // Apply model matrix
         Vertex vert{Mesh::Vertex{position, vertex.uv}, mesh.get_blend_color(), tex_idx, 0};
         vert.mode = (std::uint8_t)mode; // FIXME: for some reason the mode is not correctly set when using emplace_back, or when directly passing it to the constructor
-        this->vertex_buffer.push_back(vert);
+        vertex_out.push_back(vert);
     }
+
+    if (this->capture)
+        this->capture->add_range(vbo_sz, ebo_sz, tex_idx, false, this->premultiplied);
 }
 
-void Renderer::draw_glyph(Glyph &glyph, const Position &pos, float scale, const Colorf &color) {
-        float chr_w = (float)glyph.get_width() * scale, chr_h = (float)glyph.get_height() * scale;
-        float chr_x = pos.x + glyph.get_bearing() * scale;
-        float chr_y = pos.y - chr_h - glyph.get_bitmap_top() * scale;
-
-        std::vector<Mesh::Vertex> vertices = {
-            { {chr_x,         chr_y + chr_h, pos.z}, {0.0, 0.0} },
-            { {chr_x + chr_w, chr_y + chr_h, pos.z}, {1.0, 0.0} },
-            { {chr_x + chr_w, chr_y,         pos.z}, {1.0, 1.0} },
-            { {chr_x,         chr_y,         pos.z}, {0.0, 1.0} },
-        };
-
-        auto mesh = Mesh(vertices, std::vector<Mesh::Index>{0, 1, 2, 2, 3, 0}, glyph.get_texture(), color);
-        add_mesh(mesh, glm::mat4(1.0f), RenderingMode::AlphaMap);
-}
-
-void Renderer::draw_string(Font *font, const std::u16string &str, const Position &pos, float scale, const Colorf &color) {
-    int last_codepoint = 0;
-    Position cur_pos = pos;
-    Font *cur_font = font;
-    int ascender = 0, descender = 0;
-
-    for (char16_t chr: str) {
-        if (chr == u'\n') {
-            cur_pos.y -= (ascender + descender + 40.0f) * scale; // ??? font->linegap == 0
-            cur_pos.x = pos.x;
-            continue;
-        }
+int Renderer::get_texture_idx(gl::Texture2d &texture) {
+    if (this->capture)
+        return this->capture->get_texture_idx(texture);
+
+    if (uses_bindless()) {
+        auto handle = texture.get_bindless_handle();
+        if (!this->texture_handles.empty() && (this->texture_handles.back() == handle))
+            return this->texture_handles.size() - 1;
+
+        auto [idx, inserted] = this->texture_indices.try_emplace(handle, (std::uint32_t)this->texture_handles.size());
+        if (inserted)
+            this->texture_handles.push_back(handle);
+        return *idx;
+    }
+
+    // Consecutive draws very often use the same texture (eg. glyphs from the same atlas page)
+    if (!this->textures.empty() && (this->textures.back() == &texture))
+        return this->textures.size() - 1;
 
-        cur_font = font;
-        if (!cur_font->has_glyph(chr) && !(cur_font = find_font(chr)))
-            continue;
+    auto it = std::find(this->textures.begin(), this->textures.end(), &texture);
+    if (it != this->textures.end())
+        return it - this->textures.begin();
 
-        ascender  = std::max(ascender,  cur_font->get_ascender());
-        descender = std::max(descender, cur_font->get_descender());
+    if (this->textures.size() >= this->max_textures)
+        end();
+    this->textures.push_back(&texture);
+    return this->textures.size() - 1;
+}
+
+int Renderer::get_texture_array_idx(gl::Texture2dArray &array) {
+    if (this->capture)
+        return this->capture->get_texture_array_idx(array);
+
+    if (!this->texture_arrays.empty() && (this->texture_arrays.back() == &array))
+        return this->texture_arrays.size() - 1;
+
+    auto it = std::find(this->texture_arrays.begin(), this->texture_arrays.end(), &array);
+    if (it != this->texture_arrays.end())
+        return it - this->texture_arrays.begin();
+
+    if (this->texture_arrays.size() >= this->max_texture_arrays)
+        end();
+    this->texture_arrays.push_back(&array);
+    return this->texture_arrays.size() - 1;
+}
+
+void Renderer::add_quad(gl::Texture2d &texture, const std::array<Mesh::Vertex, 4> &vertices, const Colorf &color,
+        RenderingMode mode) {
+    if (!this->capture && ((this->vertex_buffer.size() + 4 > this->max_vertices)
+            || (this->index_buffer.size() + 6 > this->max_indices)))
+        end();
+
+    int tex_idx = get_texture_idx(texture);
+    add_quad_vertices(tex_idx, -1, vertices, color, mode);
+}
 
-        auto &glyph = cur_font->get_glyph(chr);
-        draw_glyph(glyph, cur_pos, scale, color);
+void Renderer::add_quad(const ResourceManager::TextureLayer &layer, const std::array<Mesh::Vertex, 4> &vertices,
+        const Colorf &color, RenderingMode mode) {
+    if (!this->capture && ((this->vertex_buffer.size() + 4 > this->max_vertices)
+            || (this->index_buffer.size() + 6 > this->max_indices)))
+        end();
 
-        cur_pos.x += glyph.get_advance() * scale;
-        if (last_codepoint)
-            cur_pos.x += cur_font->get_kerning(last_codepoint, glyph.get_codepoint()) * scale;
-        last_codepoint = glyph.get_codepoint();
+    int tex_idx = get_texture_array_idx(*layer.array);
+    add_quad_vertices(tex_idx, layer.layer, vertices, color, mode);
+}
+
+void Renderer::add_quad_vertices(int tex_idx, int layer, const std::array<Mesh::Vertex, 4> &vertices,
+        const Colorf &color, RenderingMode mode) {
+    auto &vertex_out = get_vertex_target();
+    auto &index_out  = get_index_target();
+    auto vbo_sz = vertex_out.size(), ebo_sz = index_out.size();
+    auto base = this->capture ? 0 : vbo_sz;
+    for (auto index: {0, 1, 2, 2, 3, 0})
+        index_out.emplace_back(base + index);
+    for (const auto &vertex: vertices) {
+        Vertex vert{vertex, color, tex_idx, 0};
+        vert.mode  = (std::uint8_t)mode;
+        vert.layer = layer;
+        vertex_out.push_back(vert);
     }
+
+    if (this->capture)
+        this->capture->add_range(vbo_sz, ebo_sz, tex_idx, layer >= 0, this->premultiplied);
+}
+
+void Renderer::begin_capture(DrawList &list) {
+    CMW_TRY_THROW(!this->capture, std::logic_error("Nested draw list capture"));
+    list.clear();
+    list.epoch = Font::get_eviction_epoch();
+    this->capture = &list;
 }
 
-void Renderer::draw_string(const std::u16string &str, const Position &pos, float scale, const Colorf &color) {
-    int last_codepoint = 0;
-    Position cur_pos = pos;
-    Font *font = nullptr;
-    int ascender = 0, descender = 0;
+void Renderer::end_capture() {
+    this->capture = nullptr;
+}
 
-    for (char16_t chr: str) {
-        if (chr == u'\n') {
-            cur_pos.y -= (ascender + descender + 40.0f) * scale; // ??? font->linegap == 0
-            cur_pos.x = pos.x;
-            continue;
-        }
+void Renderer::submit(const DrawList &list) {
+    if (list.is_stale()) { // Some of its glyph textures may have been freed
+        CMW_WARN("Skipping stale draw list\n");
+        return;
+    }
+
+    for (auto [font, page]: list.pages) {
+        font->touch_page(page);
+        record_page(font, page);
+    }
+
+    auto premultiplied = this->premultiplied;
+    for (const auto &range: list.ranges) {
+        set_premultiplied(range.premultiplied);
+        if (!this->capture && ((this->vertex_buffer.size() + range.nb_vertices > this->max_vertices)
+                || (this->index_buffer.size() + range.nb_indices > this->max_indices)))
+            end();
+
+        int tex_idx = range.is_array ? get_texture_array_idx(*list.texture_arrays[range.texture])
+            : get_texture_idx(*list.textures[range.texture]);
+
+        auto &vertex_out = get_vertex_target();
+        auto &index_out  = get_index_target();
+        auto vbo_sz = vertex_out.size(), ebo_sz = index_out.size();
+        auto base = this->capture ? 0 : vbo_sz;
+
+        auto first_index = list.indices.begin() + range.first_index;
+        std::transform(first_index, first_index + range.nb_indices, std::back_inserter(index_out),
+            [base](const Index &index) { return Index(base + index.index); });
+
+        auto first_vertex = list.vertices.begin() + range.first_vertex;
+        std::transform(first_vertex, first_vertex + range.nb_vertices, std::back_inserter(vertex_out),
+            [tex_idx](Vertex vertex) { vertex.tex_idx = tex_idx; return vertex; });
+
+        if (this->capture)
+            this->capture->add_range(vbo_sz, ebo_sz, tex_idx, range.is_array, this->premultiplied);
+    }
+    set_premultiplied(premultiplied);
+}
 
-        if (!(font = find_font(chr)))
-            continue;
+void Renderer::draw_texture(gl::Texture2d &texture, const Position &pos, float width, float height,
+        const Colorf &color) {
+    add_quad(texture, {{
+        { {pos.x,         pos.y + height, pos.z}, {0.0f, 0.0f} },
+        { {pos.x + width, pos.y + height, pos.z}, {1.0f, 0.0f} },
+        { {pos.x + width, pos.y,          pos.z}, {1.0f, 1.0f} },
+        { {pos.x,         pos.y,          pos.z}, {0.0f, 1.0f} },
+    }}, color);
+}
+
+void Renderer::draw_texture_layer(const ResourceManager::TextureLayer &layer, const Position &pos, float width,
+        float height, const Colorf &color) {
+    // Images are flipped on load, so the bottom row is at v = 0
+    add_quad(layer, {{
+        { {pos.x,         pos.y + height, pos.z}, {0.0f, 0.0f} },
+        { {pos.x + width, pos.y + height, pos.z}, {1.0f, 0.0f} },
+        { {pos.x + width, pos.y,          pos.z}, {1.0f, 1.0f} },
+        { {pos.x,         pos.y,          pos.z}, {0.0f, 1.0f} },
+    }}, color);
+}
 
-        ascender  = std::max(ascender,  font->get_ascender());
-        descender = std::max(descender, font->get_descender());
+void Renderer::draw_glyph(Glyph &glyph, const Position &pos, float scale, const Colorf &color) {
+    add_quad(glyph.get_texture(), TextBatch::make_quad(glyph, pos, scale), color, RenderingMode::AlphaMap);
+}
 
-        auto &glyph = font->get_glyph(chr);
-        draw_glyph(glyph, cur_pos, scale, color);
+void Renderer::submit(TextBatch &batch) {
+    if (!batch.is_built()) {
+        batch.resolve([this](char32_t chr) { return find_font(chr); });
+        batch.build();
+    }
 
-        cur_pos.x += glyph.get_advance() * scale;
-        if (last_codepoint)
-            cur_pos.x += font->get_kerning(last_codepoint, glyph.get_codepoint()) * scale;
-        last_codepoint = glyph.get_codepoint();
+    for (auto [font, page]: batch.get_pages()) {
+        font->touch_page(page);
+        record_page(font, page);
     }
+    for (const auto &quad: batch.get_quads())
+        add_quad(*quad.texture, quad.vertices, quad.color, RenderingMode::AlphaMap);
+}
+
+std::future<void> Renderer::build_async(TextBatch &batch) {
+    batch.resolve([this](char32_t chr) { return find_font(chr); });
+    return this->resource_man.get_workers().submit([&batch]() { batch.build(); });
+}
+
+void Renderer::draw_layout(const TextLayout &layout, const Position &pos, const Colorf &color) {
+    for (auto &glyph: layout.get_glyphs()) {
+        auto &used = glyph.font->use_glyph(*glyph.glyph);
+        record_page(glyph.font, used.get_page());
+        draw_glyph(used, {pos.x + glyph.pos.x, pos.y + glyph.pos.y, pos.z}, layout.get_scale(), color);
+    }
+}
+
+void Renderer::draw_string(Font *font, std::u16string_view str, const Position &pos, float scale, const Colorf &color) {
+    layout_string(this->text_layout, font, str, scale);
+    draw_layout(this->text_layout, pos, color);
+}
+
+void Renderer::draw_string(Font *font, std::string_view str, const Position &pos, float scale, const Colorf &color) {
+    layout_string(this->text_layout, font, str, scale);
+    draw_layout(this->text_layout, pos, color);
+}
+
+void Renderer::draw_string(std::u16string_view str, const Position &pos, float scale, const Colorf &color) {
+    draw_string(nullptr, str, pos, scale, color);
+}
+
+void Renderer::draw_string(std::string_view str, const Position &pos, float scale, const Colorf &color) {
+    draw_string(nullptr, str, pos, scale, color);
 }
 
 } // namespace cmw
@@ -15,35 +15,615 @@
 // You should have received a copy of the GNU General Public License
 // along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include "cmw/core/text.hpp"
+#include "cmw/gl/extensions.hpp"
 #include "cmw/gl/texture.hpp"
+#include "cmw/gl/texture_container.hpp"
 #include "cmw/gl/shader_program.hpp"
+#include "cmw/utils/bcn.hpp"
+#include "cmw/utils/hash.hpp"
+#include "cmw/utils/time.hpp"
 
 #include "cmw/core/resource_manager.hpp"
 
 namespace cmw {
 
 ResourceManager::ResourceManager() {
-    auto pair = this->textures.try_emplace(WhiteTexture);
-    this->white_texture = &pair.first->second;
+    // stb_image only has a global flag, set it before any worker can decode
+    stbi_set_flip_vertically_on_load(true);
+
+    // Sources are shared by all managers, only mount the archive for the first one
+    [[maybe_unused]] static bool archive_mounted = []() {
+        if (auto archive = std::make_unique<ArchiveSource>(); archive->load(get_asset_path(ArchiveName))) {
+            mount(std::move(archive));
+            return true;
+        }
+        return false;
+    }();
+
+    mkdir(CacheDirectory.c_str(), 0755);
+    this->compress_textures = gl::has_extension("GL_EXT_texture_compression_s3tc");
+    if (gl::ext::MaxShaderCompilerThreads)
+        gl::ext::MaxShaderCompilerThreads(0xffffffff); // Let the driver pick the number of threads
+
+    auto &white = *this->textures.try_emplace(intern_path(WhiteTexture), TextureEntry{this->texture_pool.create()}).first;
+    this->white_texture = white.handle.get();
     this->white_texture->set_blank_data(10, 10);
     this->white_texture->generate_mipmap();
+    white.pinned = true;
+    set_texture_size(white, 10 * 10 * 3 * 4 / 3);
+}
+
+gl::Texture2d &ResourceManager::get_texture(PathId path) {
+    auto &entry = load_texture(path, false);
+    entry.pinned = true;
+    return *entry.handle;
+}
+
+gl::Texture2d &ResourceManager::get_texture_async(PathId path) {
+    auto &entry = load_texture(path, true);
+    entry.pinned = true;
+    return *entry.handle;
+}
+
+ResourceManager::TextureHandle ResourceManager::acquire_texture(PathId path) {
+    return load_texture(path, false).handle;
+}
+
+ResourceManager::TextureHandle ResourceManager::acquire_texture_async(PathId path) {
+    return load_texture(path, true).handle;
+}
+
+ResourceManager::TextureEntry &ResourceManager::load_texture(PathId path, bool async) {
+    if (auto *entry = this->textures.find(path)) {
+        this->texture_pool.touch(entry->handle);
+        return *entry;
+    }
+
+    if (!async) {
+        auto image = load_image(get_path(path), this->compress_textures);
+        CMW_TRY_THROW(image.container, std::runtime_error("Could not load texture file"));
+        auto &entry = *this->textures.try_emplace(path, TextureEntry{this->texture_pool.create()}).first;
+        entry.handle->set_data(image.container);
+        set_texture_size(entry, image.container.get_data_size());
+        return entry;
+    }
+
+    auto &entry = *this->textures.try_emplace(path, TextureEntry{this->texture_pool.create()}).first;
+    std::uint8_t white[] = {255, 255, 255, 255};
+    entry.handle->set_data(white, 1, 1, GL_RGBA, GL_RGBA);
+    entry.handle->set_parameters(std::pair{GL_TEXTURE_MIN_FILTER, GL_LINEAR}, std::pair{GL_TEXTURE_MAG_FILTER, GL_LINEAR});
+    set_texture_size(entry, sizeof(white));
+
+    // The pending upload holds a handle, so the texture can't be evicted before it is uploaded
+    this->pending_uploads.push_back({path, entry.handle,
+        this->workers.submit([path = get_path(path), compress = this->compress_textures]() {
+            return load_image(path, compress);
+        })});
+    return entry;
+}
+
+ResourceManager::TextureLayer ResourceManager::get_texture_layer(PathId path) {
+    if (auto *layer = this->texture_layers.find(path))
+        return *layer;
+
+    auto image = load_image(get_path(path), this->compress_textures);
+    CMW_TRY_THROW(image.container, std::runtime_error("Could not load texture file"));
+
+    auto &array = find_texture_array(image.container);
+    TextureLayer layer = {array.texture.get(), array.nb_used++};
+    layer.array->bind();
+    layer.array->set_layer_data(layer.layer, image.container);
+    return *this->texture_layers.try_emplace(path, layer).first;
+}
+
+ResourceManager::TextureArray &ResourceManager::find_texture_array(const gl::TextureContainer &container) {
+    auto &hdr = container.get_header();
+    auto it = std::find_if(this->texture_arrays.begin(), this->texture_arrays.end(), [&hdr](const TextureArray &array) {
+        return (array.format == hdr.format) && (array.width == hdr.width) && (array.height == hdr.height)
+            && (array.nb_levels == hdr.nb_levels) && (array.nb_used < array.texture->get_nb_layers());
+    });
+    if (it != this->texture_arrays.end())
+        return *it;
+
+    GLint max_layers;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+    auto nb_layers = std::min(TextureArrayLayers, (std::uint32_t)max_layers);
+
+    auto &array = this->texture_arrays.emplace_back(TextureArray{hdr.format, hdr.width, hdr.height, hdr.nb_levels,
+        std::make_unique<gl::Texture2dArray>()});
+    array.texture->set_storage(container, nb_layers);
+    this->textures_vram += container.get_data_size() * nb_layers;
+    CMW_TRACE("Allocated texture array %ux%u, %u layers\n", hdr.width, hdr.height, nb_layers);
+    return array;
+}
+
+void ResourceManager::set_texture_size(TextureEntry &entry, std::size_t size) {
+    this->textures_vram += size - entry.size;
+    entry.size = size;
+}
+
+std::size_t ResourceManager::process_uploads(float budget_ms) {
+    using Watch = StopWatch<std::chrono::steady_clock, std::chrono::microseconds>;
+
+    Watch watch;
+    std::size_t nb_uploaded = 0;
+    for (auto it = this->pending_uploads.begin(); it != this->pending_uploads.end();) {
+        if ((nb_uploaded != 0) && (watch.elapsed<float>() / 1000.0f >= budget_ms))
+            break;
+        if (it->image.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++it;
+            continue;
+        }
+
+        auto image = it->image.get();
+        if (!image.container) {
+            CMW_ERROR("Failed to load texture %s, keeping its previous data\n", get_path(it->path).c_str());
+        } else {
+            it->texture->bind();
+            it->texture->set_data(image.container);
+            if (auto *entry = this->textures.find(it->path))
+                set_texture_size(*entry, image.container.get_data_size());
+            auto &hdr = image.container.get_header();
+            CMW_TRACE("Uploaded %s (%ux%u, %u levels)\n", get_path(it->path).c_str(), hdr.width, hdr.height, hdr.nb_levels);
+        }
+
+        it = this->pending_uploads.erase(it);
+        ++nb_uploaded;
+    }
+    return nb_uploaded;
+}
+
+ResourceManager::LoadedImage ResourceManager::load_image(const std::string &path, bool compress) {
+    using Format = gl::TextureContainer::Format;
+
+    LoadedImage image;
+    auto source = map_asset(path);
+    if (!source)
+        return image;
+
+    // Already converted offline
+    if (image.container.parse(source.data(), source.size())) {
+        image.data = std::move(source);
+        return image;
+    }
+
+    // Converted on a previous run
+    auto hash = fnv1a(source.data(), source.size());
+    char name[64];
+    std::snprintf(name, sizeof(name), "%016lx-%d.cmwt", (unsigned long)hash, compress);
+    auto cache_path = CacheDirectory + name;
+    if (AssetView cached(MappedFile{cache_path}); image.container.parse(cached.data(), cached.size())
+            && (image.container.get_header().source_hash == hash)) {
+        image.data = std::move(cached);
+        return image;
+    }
+
+    int width, height, nchan;
+    stbi_uc *data = stbi_load_from_memory(source.bytes(), source.size(), &width, &height, &nchan, 0);
+    if (!data) {
+        CMW_ERROR("%s\n", stbi_failure_reason());
+        return image;
+    }
+
+    // Grey and grey-alpha images only keep their grey channel
+    int src_nchan = nchan;
+    if (nchan < 3)
+        nchan = 1;
+    Format fmt = (nchan == 4) ? Format::Rgba8 : (nchan == 3) ? Format::Rgb8 : Format::R8;
+
+    // Mip chain
+    std::vector<std::vector<std::uint8_t>> levels;
+    std::size_t nb_pixels = (std::size_t)width * height;
+    auto &base = levels.emplace_back(nb_pixels * nchan);
+    if (src_nchan == nchan) {
+        std::copy_n(data, base.size(), base.begin());
+    } else {
+        for (std::size_t i = 0; i < nb_pixels; ++i)
+            base[i] = data[i * src_nchan];
+    }
+    stbi_image_free(data);
+
+    for (int w = width, h = height; (w > 1) || (h > 1); w = std::max(w / 2, 1), h = std::max(h / 2, 1))
+        levels.push_back(downsample(levels.back(), w, h, nchan));
+
+    if (compress && (nchan >= 3)) {
+        fmt = (nchan == 4) ? Format::Bc3 : Format::Bc1;
+        for (std::size_t i = 0; i < levels.size(); ++i) {
+            std::vector<std::uint8_t> blocks;
+            int w = std::max(width >> i, 1), h = std::max(height >> i, 1);
+            if (fmt == Format::Bc3)
+                bcn::encode_bc3(levels[i].data(), w, h, nchan, blocks);
+            else
+                bcn::encode_bc1(levels[i].data(), w, h, nchan, blocks);
+            levels[i] = std::move(blocks);
+        }
+    }
+
+    image.data = AssetView(gl::TextureContainer::build(fmt, width, height, hash, levels));
+    image.container.parse(image.data.data(), image.data.size());
+
+    // Identical images may be converted concurrently, each writer needs its own temporary file
+    static std::atomic_uint32_t nb_tmp_files = 0;
+    auto tmp_path = cache_path + "." + std::to_string(nb_tmp_files++) + ".tmp";
+    if (FILE *fp = std::fopen(tmp_path.c_str(), "wb"); fp) {
+        bool ok = std::fwrite(image.data.data(), 1, image.data.size(), fp) == image.data.size();
+        ok &= !std::fclose(fp);
+        if (!ok || std::rename(tmp_path.c_str(), cache_path.c_str()))
+            std::remove(tmp_path.c_str());
+        else
+            CMW_TRACE("Converted %s to %s\n", path.c_str(), cache_path.c_str());
+    }
+    return image;
+}
+
+std::vector<std::uint8_t> ResourceManager::downsample(const std::vector<std::uint8_t> &src, int width, int height, int nchan) {
+    // 2x2 box filter, odd edges are clamped
+    int dst_w = std::max(width / 2, 1), dst_h = std::max(height / 2, 1);
+    std::vector<std::uint8_t> dst((std::size_t)dst_w * dst_h * nchan);
+    for (int y = 0; y < dst_h; ++y) {
+        int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+        for (int x = 0; x < dst_w; ++x) {
+            int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+            for (int c = 0; c < nchan; ++c) {
+                unsigned int sum = src[(y0 * width + x0) * nchan + c] + src[(y0 * width + x1) * nchan + c]
+                    + src[(y1 * width + x0) * nchan + c] + src[(y1 * width + x1) * nchan + c];
+                dst[(y * dst_w + x) * nchan + c] = (sum + 2) / 4;
+            }
+        }
+    }
+    return dst;
 }
 
-gl::Texture2d &ResourceManager::get_texture(const std::string &path) {
-    auto it = this->textures.find(path);
-    if (it != this->textures.end())
-        return it->second;
-    auto pair = this->textures.try_emplace(path, path);
-    return pair.first->second;
+gl::ShaderProgram &ResourceManager::get_shader(PathId vert_path, PathId frag_path) {
+    auto &program = get_shader_async(vert_path, frag_path);
+    auto &entry = *this->shader_programs.find(get_program_key(vert_path, frag_path));
+    auto it = std::find_if(this->pending_programs.begin(), this->pending_programs.end(),
+        [&program](const auto &pending) { return pending.program == &program; });
+    if (it != this->pending_programs.end()) {
+        entry.failed = !finish_program(*it);
+        this->pending_programs.erase(it);
+    }
+
+    CMW_TRY_THROW(!entry.failed, std::runtime_error("Could not build shader program"));
+    return program;
+}
+
+gl::ShaderProgram &ResourceManager::get_shader_async(PathId vert_path, PathId frag_path) {
+    auto key = get_program_key(vert_path, frag_path);
+    if (auto *entry = this->shader_programs.find(key))
+        return *entry->program;
+
+    auto vert_src = map_asset(get_path(vert_path)), frag_src = map_asset(get_path(frag_path));
+    CMW_TRY_THROW(vert_src && frag_src, std::runtime_error("Could not load shader source"));
+    auto &program = *this->shader_programs.try_emplace(key, ShaderEntry{std::make_unique<gl::ShaderProgram>()}).first->program;
+
+    // Programs linked on a previous run are reloaded from the driver binary, skipping compilation
+    std::string cache_path;
+    if (gl::ShaderProgram::has_binary_support()) {
+        cache_path = get_program_cache_path(vert_src, frag_src);
+        if (program.load_binary(cache_path)) {
+            CMW_TRACE("Loaded program binary %s\n", cache_path.c_str());
+            this->shaders_vram += program.get_binary_size();
+            return program;
+        }
+        program.set_binary_retrievable();
+    }
+
+    // No status is queried here, since that would make the driver finish the work before returning
+    auto vert = std::make_unique<gl::VertexShader>();
+    auto frag = std::make_unique<gl::FragmentShader>();
+    vert->set_source(vert_src.str());
+    frag->set_source(frag_src.str());
+    vert->begin_compile();
+    frag->begin_compile();
+    program.attach_shaders(*vert, *frag);
+    program.begin_link();
+    this->pending_programs.push_back({key, &program, std::move(cache_path), std::move(vert), std::move(frag)});
+    return program;
+}
+
+std::size_t ResourceManager::process_shaders() {
+    std::size_t nb_done = 0;
+    for (auto it = this->pending_programs.begin(); it != this->pending_programs.end();) {
+        if (!it->program->is_complete()) {
+            ++it;
+            continue;
+        }
+        if (!finish_program(*it)) {
+            this->shader_programs.find(it->key)->failed = true;
+            CMW_ERROR("Failed to build shader program %s/%s\n",
+                get_path(it->key >> 32).c_str(), get_path(it->key & 0xffffffff).c_str());
+        }
+        it = this->pending_programs.erase(it), ++nb_done;
+    }
+    return nb_done;
+}
+
+bool ResourceManager::finish_program(PendingProgram &pending) {
+    auto &program = *pending.program;
+    program.detach_shaders(*pending.vert, *pending.frag);
+    if (!program.is_linked()) {
+        if (!pending.vert->is_compiled())
+            pending.vert->print_log();
+        if (!pending.frag->is_compiled())
+            pending.frag->print_log();
+        program.print_log();
+        return false;
+    }
+
+    if (!pending.cache_path.empty()) {
+        this->shaders_vram += program.get_binary_size();
+        if (!program.save_binary(pending.cache_path))
+            CMW_WARN("Failed to save program binary %s\n", pending.cache_path.c_str());
+    }
+    return true;
+}
+
+std::string ResourceManager::get_program_cache_path(const AssetView &vert_src, const AssetView &frag_src) {
+    auto hash = fnv1a(frag_src.str(), fnv1a(vert_src.str(), gl::ShaderProgram::get_driver_hash()));
+    char name[0x40];
+    std::snprintf(name, sizeof(name), "%016lx.cmwp", (unsigned long)hash);
+    return CacheDirectory + name;
+}
+
+bool ResourceManager::enable_hot_reload(bool enable) {
+    if (!enable) {
+        this->watcher.reset();
+        return true;
+    }
+    if (!this->watcher)
+        this->watcher = std::make_unique<FileWatcher>(get_asset_path(""));
+    if (!*this->watcher) {
+        CMW_WARN("Hot reload is unsupported on this platform\n");
+        this->watcher.reset();
+        return false;
+    }
+    return true;
+}
+
+std::size_t ResourceManager::reload_changed() {
+    this->changed_files.clear();
+    this->watcher->poll(this->changed_files);
+
+    std::size_t nb_reloaded = 0;
+    for (const auto &file: this->changed_files) {
+        // Files that were never loaded were never interned either
+        auto path = this->paths.find(file);
+        if (path == StringTable::Invalid)
+            continue;
+
+        if (auto *entry = this->textures.find(path)) {
+            CMW_INFO("Reloading texture %s\n", file.c_str());
+            // An older load finishing after this one would overwrite it with stale data, drop it
+            this->pending_uploads.erase(std::remove_if(this->pending_uploads.begin(), this->pending_uploads.end(),
+                [path](const PendingUpload &upload) { return upload.path == path; }), this->pending_uploads.end());
+            this->pending_uploads.push_back({path, entry->handle,
+                this->workers.submit([file, compress = this->compress_textures]() {
+                    return load_image(file, compress);
+                })});
+            ++nb_reloaded;
+        }
+
+        // Layers are small and must keep their shape, so they are reloaded in place
+        if (auto *layer = this->texture_layers.find(path)) {
+            CMW_INFO("Reloading texture layer %s\n", file.c_str());
+            auto image = load_image(file, this->compress_textures);
+            auto &array = *std::find_if(this->texture_arrays.begin(), this->texture_arrays.end(),
+                [layer](const TextureArray &array) { return array.texture.get() == layer->array; });
+            auto *hdr = image.container ? &image.container.get_header() : nullptr;
+            if (!hdr || (hdr->format != array.format) || (hdr->width != array.width) || (hdr->height != array.height)
+                    || (hdr->nb_levels != array.nb_levels)) {
+                CMW_ERROR("Failed to reload texture layer %s, keeping its previous data\n", file.c_str());
+            } else {
+                array.texture->bind();
+                array.texture->set_layer_data(layer->layer, image.container);
+                ++nb_reloaded;
+            }
+        }
+
+        this->shader_programs.for_each([&](std::uint64_t key, auto &entry) {
+            if ((((key >> 32) == path) || ((key & 0xffffffff) == path)) && reload_program(key, *entry.program))
+                ++nb_reloaded, entry.failed = false;
+        });
+    }
+    return nb_reloaded;
+}
+
+bool ResourceManager::reload_program(std::uint64_t key, gl::ShaderProgram &program) {
+    auto &vert_path = get_path(key >> 32), &frag_path = get_path(key & 0xffffffff);
+    if (std::any_of(this->pending_programs.begin(), this->pending_programs.end(),
+            [key](const auto &pending) { return pending.key == key; })) {
+        CMW_WARN("Not reloading shader program %s/%s, it is still being linked\n", vert_path.c_str(), frag_path.c_str());
+        return false;
+    }
+
+    CMW_INFO("Reloading shader program %s/%s\n", vert_path.c_str(), frag_path.c_str());
+    auto vert_src = map_asset(vert_path), frag_src = map_asset(frag_path);
+    if (!vert_src || !frag_src)
+        return false;
+
+    // The new version is built in a separate program, since a failed link would leave the current one unusable
+    gl::ShaderProgram reloaded;
+    bool has_binary = gl::ShaderProgram::has_binary_support();
+    try {
+        gl::VertexShader vert;
+        gl::FragmentShader frag;
+        vert.load_source(vert_src.str());
+        frag.load_source(frag_src.str());
+        if (has_binary)
+            reloaded.set_binary_retrievable();
+        reloaded.link_shaders(vert, frag);
+    } catch (const std::runtime_error &e) {
+        CMW_ERROR("Failed to reload shader program %s/%s (%s), keeping the previous version\n",
+            vert_path.c_str(), frag_path.c_str(), e.what());
+        return false;
+    }
+
+    reloaded.copy_uniforms(program);
+    program.swap(reloaded);
+    if (has_binary) {
+        this->shaders_vram += program.get_binary_size() - reloaded.get_binary_size();
+        program.save_binary(get_program_cache_path(vert_src, frag_src));
+    }
+    return true;
+}
+
+ResourceManager::MemoryUsage ResourceManager::get_memory_usage(ResourceType type) const {
+    MemoryUsage usage;
+    switch (type) {
+        case ResourceType::Texture:
+            usage.vram = this->textures_vram, usage.nb_resources = this->textures.size() + this->texture_arrays.size();
+            break;
+        case ResourceType::GlyphPage:
+            for (auto &font: this->fonts) {
+                usage.vram += font->get_vram_usage(), usage.ram += font->get_ram_usage();
+                usage.nb_resources += font->get_nb_resident_pages();
+            }
+            break;
+        case ResourceType::Shader:
+            usage.vram = this->shaders_vram, usage.nb_resources = this->shader_programs.size();
+            break;
+    }
+    return usage;
+}
+
+ResourceManager::MemoryUsage ResourceManager::get_memory_usage() const {
+    MemoryUsage total;
+    for (auto type: {ResourceType::Texture, ResourceType::GlyphPage, ResourceType::Shader}) {
+        auto usage = get_memory_usage(type);
+        total.vram += usage.vram, total.ram += usage.ram, total.nb_resources += usage.nb_resources;
+    }
+    return total;
 }
 
-gl::ShaderProgram &ResourceManager::get_shader(const std::string &vert_path, const std::string &frag_path) {
-    std::string key = vert_path + frag_path;
-    auto it = this->shader_programs.find(key);
-    if (it != this->shader_programs.end())
-        return it->second;
-    auto pair = this->shader_programs.try_emplace(key, gl::VertexShader{vert_path}, gl::FragmentShader{frag_path});
-    return pair.first->second;
+std::size_t ResourceManager::collect() {
+    // Resources used during the frame that just ended are stamped with its number
+    std::uint64_t last_frame = this->frame++;
+    this->texture_pool.set_clock(this->frame);
+    for (auto &font: this->fonts)
+        font->set_frame(this->frame);
+
+    if (!this->budget.vram && !this->budget.ram)
+        return 0;
+    auto usage = get_memory_usage();
+    auto over_vram = [&]() { return this->budget.vram && (usage.vram > this->budget.vram); };
+    auto over_ram  = [&]() { return this->budget.ram  && (usage.ram  > this->budget.ram);  };
+    if (!over_vram() && !over_ram())
+        return 0;
+
+    struct Candidate {
+        std::uint64_t last_used;
+        std::size_t vram, ram;
+        PathId texture; // Glyph page if font is set
+        Font *font;
+        std::size_t page;
+    };
+
+    std::vector<Candidate> candidates;
+    this->textures.for_each([&](PathId path, const TextureEntry &entry) {
+        if (!entry.pinned && (entry.handle.get_use_count() == 1) && (entry.handle.get_last_used() < last_frame))
+            candidates.push_back({entry.handle.get_last_used(), entry.size, 0, path, nullptr, 0});
+    });
+    for (auto &font: this->fonts) {
+        for (std::size_t i = 0; i < font->get_nb_pages(); ++i)
+            if (font->is_page_resident(i) && (font->get_page_last_used(i) < last_frame))
+                candidates.push_back({font->get_page_last_used(i), font->get_page_vram(i), font->get_page_ram(i),
+                    0, font.get(), i});
+    }
+    std::sort(candidates.begin(), candidates.end(),
+        [](const auto &lhs, const auto &rhs) { return lhs.last_used < rhs.last_used; });
+
+    std::size_t freed = 0;
+    for (auto &candidate: candidates) {
+        bool vram = over_vram(), ram = over_ram();
+        if (!vram && !ram)
+            break;
+        if (!(vram && candidate.vram) && !(ram && candidate.ram))
+            continue;
+
+        if (candidate.font) {
+            candidate.font->evict_page(candidate.page);
+        } else {
+            CMW_TRACE("Evicting texture %s\n", get_path(candidate.texture).c_str());
+            this->textures_vram -= candidate.vram;
+            this->textures.erase(candidate.texture);
+        }
+        usage.vram -= candidate.vram, usage.ram -= candidate.ram;
+        freed += candidate.vram + candidate.ram;
+    }
+
+    if (over_vram() || over_ram())
+        CMW_WARN("Over memory budget after eviction (%zu bytes of VRAM, %zu of RAM)\n", usage.vram, usage.ram);
+    return freed;
+}
+
+void ResourceManager::preload_fonts() {
+    constexpr char32_t chunk_size = 64;
+    using Watch = StopWatch<std::chrono::steady_clock, std::chrono::microseconds>;
+    using Chunk = std::pair<std::vector<Font::RasterizedGlyph>, float>;
+
+    Watch total_watch;
+    mkdir(CacheDirectory.c_str(), 0755);
+
+    // Submit every chunk of every font before waiting on any, so that all fonts are rasterized concurrently
+    std::vector<std::pair<Font *, std::vector<std::future<Chunk>>>> jobs;
+    for (auto &font: this->fonts) {
+        if (!font->needs_preload())
+            continue;
+
+        Watch baked_watch;
+        if (auto path = font->get_baked_path(CacheDirectory); !path.empty() && font->load_baked(path)) {
+            auto &stats = font->get_preload_stats();
+            stats.upload_time = baked_watch.elapsed<float>() / 1000.0f;
+            CMW_INFO("Loaded baked font %p: %zu glyphs in %zu pages in %.2fms\n",
+                font.get(), stats.nb_glyphs, stats.nb_pages, stats.upload_time);
+            continue;
+        }
+        auto &[f, futures] = jobs.emplace_back(font.get(), std::vector<std::future<Chunk>>{});
+        for (char32_t first = font->get_first_cached(); first <= font->get_last_cached(); first += chunk_size) {
+            char32_t last = std::min<char32_t>(first + chunk_size - 1, font->get_last_cached());
+            futures.push_back(this->workers.submit([f = f, first, last]() -> Chunk {
+                Watch watch;
+                auto glyphs = f->rasterize_range(first, last);
+                return {std::move(glyphs), watch.elapsed<float>() / 1000.0f};
+            }));
+        }
+    }
+
+    for (auto &[font, futures]: jobs) {
+        auto &stats = font->get_preload_stats();
+        std::vector<Font::RasterizedGlyph> glyphs;
+        for (auto &fut: futures) {
+            auto [chunk, time] = fut.get();
+            stats.rasterize_time += time;
+            std::move(chunk.begin(), chunk.end(), std::back_inserter(glyphs));
+        }
+
+        Watch upload_watch;
+        font->upload_glyphs(glyphs);
+        stats.upload_time = upload_watch.elapsed<float>() / 1000.0f;
+
+        CMW_INFO("Preloaded font %p: %zu glyphs in %zu pages, rasterized in %.2fms (cpu), uploaded in %.2fms\n",
+            font, stats.nb_glyphs, stats.nb_pages, stats.rasterize_time, stats.upload_time);
+
+        if (auto path = font->get_baked_path(CacheDirectory); !path.empty())
+            font->save_baked(path);
+        font->release_staging();
+    }
+
+    CMW_INFO("Preloaded %zu fonts (%zu rasterized) in %.2fms on %zu threads\n",
+        this->fonts.size(), jobs.size(), total_watch.elapsed<float>() / 1000.0f, this->workers.get_nb_threads());
 }
 
 } // namespace cmw
@@ -0,0 +1,138 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "cmw/core/log.hpp"
+#include "cmw/core/scene_graph.hpp"
+
+namespace cmw {
+
+namespace {
+
+template <typename T>
+void permute(std::vector<T> &vec, const std::vector<std::uint32_t> &remap, std::size_t size) {
+    std::vector<T> tmp(size);
+    for (std::size_t i = 0; i < remap.size(); ++i)
+        if (remap[i] != SceneGraph::Invalid)
+            tmp[remap[i]] = std::move(vec[i]);
+    vec = std::move(tmp);
+}
+
+} // namespace
+
+SceneGraph::Node SceneGraph::create(Node parent, const glm::mat4 &local) {
+    CMW_TRY_THROW((parent == Invalid) || contains(parent), std::invalid_argument("Invalid parent node"));
+
+    Node node;
+    if (!this->free_nodes.empty()) {
+        node = this->free_nodes.back();
+        this->free_nodes.pop_back();
+    } else {
+        node = this->slots.size();
+        this->slots.push_back(Invalid);
+    }
+
+    // Appending keeps the order, since the parent already has a slot
+    this->slots[node] = this->nodes.size();
+    this->nodes.push_back(node);
+    this->parents.push_back((parent != Invalid) ? get_slot(parent) : Invalid);
+    this->locals.push_back(local);
+    this->worlds.emplace_back(1.0f);
+    this->flags.push_back(Flags::Dirty);
+    return node;
+}
+
+void SceneGraph::destroy(Node node) {
+    CMW_TRY_THROW(contains(node), std::invalid_argument("Invalid node"));
+    mark_subtree(get_slot(node));
+    for (std::size_t i = 0; i < this->nodes.size(); ++i) {
+        if (this->mask[i]) {
+            this->slots[this->nodes[i]] = Invalid;
+            this->free_nodes.push_back(this->nodes[i]);
+        }
+    }
+    partition(false);
+}
+
+void SceneGraph::set_parent(Node node, Node parent) {
+    CMW_TRY_THROW(contains(node) && ((parent == Invalid) || contains(parent)), std::invalid_argument("Invalid node"));
+
+    auto slot = get_slot(node);
+    mark_subtree(slot);
+    CMW_TRY_THROW((parent == Invalid) || !this->mask[get_slot(parent)],
+        std::invalid_argument("Node can't be parented to its own subtree"));
+
+    this->parents[slot] = (parent != Invalid) ? get_slot(parent) : Invalid;
+    this->flags[slot] |= Flags::Dirty;
+
+    // The new parent comes after the node, move the subtree behind everything else
+    if ((parent != Invalid) && (get_slot(parent) > slot))
+        partition(true);
+}
+
+std::size_t SceneGraph::update() {
+    std::size_t nb_changed = 0;
+    for (std::size_t i = 0; i < this->nodes.size(); ++i) {
+        auto parent = this->parents[i];
+        bool changed = (this->flags[i] & Flags::Dirty) || ((parent != Invalid) && (this->flags[parent] & Flags::Changed));
+        this->flags[i] = changed ? Flags::Changed : 0;
+        if (!changed)
+            continue;
+        this->worlds[i] = (parent != Invalid) ? this->worlds[parent] * this->locals[i] : this->locals[i];
+        ++nb_changed;
+    }
+    return nb_changed;
+}
+
+void SceneGraph::mark_subtree(std::uint32_t slot) {
+    this->mask.assign(this->nodes.size(), 0);
+    this->mask[slot] = 1;
+    for (std::size_t i = slot + 1; i < this->nodes.size(); ++i) // Descendants always come after their ancestors
+        this->mask[i] = (this->parents[i] != Invalid) && this->mask[this->parents[i]];
+}
+
+void SceneGraph::partition(bool keep_masked) {
+    std::uint32_t size = 0;
+    this->remap.assign(this->nodes.size(), Invalid);
+    for (std::size_t i = 0; i < this->nodes.size(); ++i)
+        if (!this->mask[i])
+            this->remap[i] = size++;
+    if (keep_masked) {
+        for (std::size_t i = 0; i < this->nodes.size(); ++i)
+            if (this->mask[i])
+                this->remap[i] = size++;
+    }
+
+    for (auto &parent: this->parents)
+        if (parent != Invalid)
+            parent = this->remap[parent];
+
+    permute(this->nodes,   this->remap, size);
+    permute(this->parents, this->remap, size);
+    permute(this->locals,  this->remap, size);
+    permute(this->worlds,  this->remap, size);
+    permute(this->flags,   this->remap, size);
+
+    for (std::uint32_t i = 0; i < size; ++i)
+        this->slots[this->nodes[i]] = i;
+}
+
+} // namespace cmw
@@ -16,6 +16,8 @@
 // along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <cstdio>
+#include <cstring>
+#include <algorithm>
 #include <stdexcept>
 #include <stb_truetype.h>
 #include <glad/glad.h>
@@ -32,16 +34,7 @@
 
 namespace cmw {
 
-Glyph::Glyph(stbtt_fontinfo *font_ctx, float scale, int codepoint, int idx, void *data, int width, int height, int off_x, int off_y):
-        codepoint(codepoint), idx(idx), buf_width(width), buf_height(height), buf_off_x(off_x), buf_off_y(off_y) {
-    texture.set_data(data, width, height, GL_RED, GL_RED);
-    texture.set_parameters(
-        std::pair{GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE},
-        std::pair{GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE},
-        std::pair{GL_TEXTURE_MIN_FILTER, GL_LINEAR},
-        std::pair{GL_TEXTURE_MAG_FILTER, GL_LINEAR}
-    );
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+Glyph::Glyph(const stbtt_fontinfo *font_ctx, float scale, int codepoint, int idx): codepoint(codepoint), idx(idx) {
     stbtt_GetGlyphBitmapBox(font_ctx, idx, scale, scale, &this->x1, &this->y1, &this->x2, &this->y2);
     stbtt_GetGlyphHMetrics(font_ctx, idx, &this->advance, &this->bearing);
     this->advance *= scale; this->bearing *= scale;
@@ -53,26 +46,29 @@ Glyph::Glyph(stbtt_fontinfo *font_ctx, float scale, int codepoint, int idx, void
                                                                                                                     \
     stbtt_GetFontVMetrics(&this->font_ctx, &this->ascender, &this->descender, &this->linegap);                      \
     this->ascender *= this->font_scale; this->descender *= this->font_scale; this->linegap *= this->font_scale;     \
-                                                                                                                    \
-    for (char16_t i = first_cached; i <= last_cached; ++i)                                                          \
-        cache_glyph(i);                                                                                             \
 })
 
 #ifdef CMW_SWITCH
-Font::Font(PlSharedFontType type, char16_t first_cached, char16_t last_cached) {
+Font::Font(PlSharedFontType type, char32_t first_cached, char32_t last_cached):
+        first_cached(first_cached), last_cached(last_cached) {
     CMW_TRY_RC_THROW(plInitialize(), std::runtime_error("Failed to initialize pl"));
     CMW_TRY_RC_THROW(plGetSharedFontByType(&this->font_data, type), std::runtime_error("Failed to get font"));
+    this->font_data_ptr  = (const std::uint8_t *)this->font_data.address;
+    this->font_data_size = this->font_data.size;
     INIT_FONT(this->font_data.address);
 }
 #endif // CMW_SWITCH
 
-Font::Font(void *data, char16_t first_cached, char16_t last_cached) {
+Font::Font(void *data, char32_t first_cached, char32_t last_cached): first_cached(first_cached), last_cached(last_cached) {
     INIT_FONT(data);
 }
 
-Font::Font(const std::string &path, char16_t first_cached, char16_t last_cached) {
-    this->data = ResourceManager::read_asset<std::vector<std::uint8_t>>(path);
-    INIT_FONT(this->data.data());
+Font::Font(const std::string &path, char32_t first_cached, char32_t last_cached):
+        first_cached(first_cached), last_cached(last_cached) {
+    this->file = ResourceManager::map_asset(path);
+    CMW_TRY_THROW(this->file, std::runtime_error("Failed to open font"));
+    this->font_data_ptr = this->file.bytes(), this->font_data_size = this->file.size();
+    INIT_FONT(this->file.data());
 }
 
 Font::~Font() {
@@ -82,20 +78,460 @@ Font::~Font() {
 #endif
 }
 
-Glyph &Font::cache_glyph(char16_t chr) {
-    int w, h, x, y;
-    int idx = stbtt_FindGlyphIndex(&this->font_ctx, chr);
-    void *data = stbtt_GetGlyphBitmap(&this->font_ctx, this->font_scale, this->font_scale, idx, &w, &h, &x, &y);
-    auto pair = this->cached_glyphs.try_emplace(chr, &this->font_ctx, this->font_scale, chr, idx, data, w, h, x, y);
-    stbtt_FreeBitmap((unsigned char *)data, nullptr);
-    return pair.first->second;
+bool Font::AtlasPage::allocate(int w, int h, int &x, int &y) {
+    if (this->cursor_x + w > this->width) { // Open a new shelf
+        this->cursor_x = 0;
+        this->cursor_y += this->shelf_height + atlas_padding;
+        this->shelf_height = 0;
+    }
+    if ((w > this->width) || (this->cursor_y + h > this->height))
+        return false;
+    x = this->cursor_x, y = this->cursor_y;
+    this->cursor_x += w + atlas_padding;
+    this->shelf_height = std::max(this->shelf_height, h);
+    return true;
+}
+
+Font::AtlasPage &Font::create_page(int width, int height, void *data) {
+    auto &page = this->pages.emplace_back(AtlasPage{std::make_unique<gl::Texture2d>(), width, height});
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    page.texture->set_data(data, width, height, GL_RED, GL_RED);
+    page.texture->set_parameters(
+        std::pair{GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE},
+        std::pair{GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE},
+        std::pair{GL_TEXTURE_MIN_FILTER, GL_LINEAR},
+        std::pair{GL_TEXTURE_MAG_FILTER, GL_LINEAR}
+    );
+    return page;
+}
+
+std::vector<Font::RasterizedGlyph> Font::rasterize_range(char32_t first, char32_t last) const {
+    std::vector<RasterizedGlyph> glyphs;
+    glyphs.reserve(last - first + 1);
+    for (char32_t chr = first; chr <= last; ++chr) {
+        int idx = stbtt_FindGlyphIndex(&this->font_ctx, chr);
+        if (!idx && (first != last)) // Skip missing glyphs unless explicitly requested
+            continue;
+        int w = 0, h = 0, x, y;
+        auto *bitmap = stbtt_GetGlyphBitmap(&this->font_ctx, this->font_scale, this->font_scale, idx, &w, &h, &x, &y);
+        glyphs.push_back({chr, idx, w, h, decltype(RasterizedGlyph::bitmap)(bitmap)});
+    }
+    return glyphs;
+}
+
+void Font::upload_glyphs(std::vector<RasterizedGlyph> &glyphs) {
+    // Tallest first to keep shelves tight
+    std::sort(glyphs.begin(), glyphs.end(), [](const auto &lhs, const auto &rhs) { return lhs.height > rhs.height; });
+
+    std::vector<std::uint8_t> staging;
+    std::vector<std::pair<RasterizedGlyph *, Position2i>> placements;
+    AtlasPage packer{nullptr, atlas_width, atlas_max_height};
+
+    auto flush = [&]() {
+        if (placements.empty())
+            return;
+        int height = std::max(packer.cursor_y + packer.shelf_height, 1);
+        auto &page = create_page(atlas_width, height, staging.data());
+        page.cursor_x = packer.cursor_x, page.cursor_y = packer.cursor_y, page.shelf_height = packer.shelf_height;
+        page.staging.assign(staging.begin(), staging.begin() + atlas_width * height);
+        for (auto &[glyph, pos]: placements) {
+            auto &cached = this->cached_glyphs.try_emplace(glyph->codepoint,
+                &this->font_ctx, this->font_scale, glyph->codepoint, glyph->idx).first->second;
+            cached.set_location(page.texture.get(),
+                {(float) pos.x                  / page.width, (float) pos.y                   / page.height},
+                {(float)(pos.x + glyph->width)  / page.width, (float)(pos.y + glyph->height)  / page.height});
+            cached.page = this->pages.size() - 1;
+        }
+        placements.clear();
+        packer = AtlasPage{nullptr, atlas_width, atlas_max_height};
+    };
+
+    for (auto &glyph: glyphs) {
+        Position2i pos;
+        if (!packer.allocate(glyph.width, glyph.height, pos.x, pos.y)) {
+            flush();
+            if (!packer.allocate(glyph.width, glyph.height, pos.x, pos.y)) {
+                CMW_ERROR("Glyph %#x is too large for the atlas\n", glyph.codepoint);
+                continue;
+            }
+        }
+        if (staging.empty())
+            staging.resize(atlas_width * atlas_max_height);
+        else if (placements.empty())
+            std::fill(staging.begin(), staging.end(), 0);
+        for (int row = 0; row < glyph.height; ++row)
+            std::memcpy(&staging[(pos.y + row) * atlas_width + pos.x], glyph.bitmap.get() + row * glyph.width, glyph.width);
+        placements.emplace_back(&glyph, pos);
+    }
+    flush();
+
+    this->preloaded = true;
+    this->preload_stats.nb_glyphs += glyphs.size();
+    this->preload_stats.nb_pages   = this->pages.size();
+}
+
+Glyph &Font::cache_glyph(char32_t chr) {
+    auto glyphs = rasterize_range(chr, chr);
+    auto &glyph = glyphs.front();
+
+    Position2i pos;
+    if (this->pages.empty() || !this->pages.back().texture
+            || !this->pages.back().allocate(glyph.width, glyph.height, pos.x, pos.y)) {
+        std::vector<std::uint8_t> blank(atlas_width * atlas_width, 0);
+        CMW_TRY_THROW(create_page(atlas_width, atlas_width, blank.data()).allocate(glyph.width, glyph.height, pos.x, pos.y),
+            std::runtime_error("Glyph is too large for the atlas"));
+    }
+
+    auto &page = this->pages.back();
+    page.last_used = this->frame;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    page.texture->bind();
+    if (glyph.width && glyph.height)
+        page.texture->set_sub_data(glyph.bitmap.get(), pos.x, pos.y, glyph.width, glyph.height, GL_RED);
+
+    auto &cached = this->cached_glyphs.try_emplace(chr, &this->font_ctx, this->font_scale, chr, glyph.idx).first->second;
+    cached.set_location(page.texture.get(),
+        {(float) pos.x                 / page.width, (float) pos.y                  / page.height},
+        {(float)(pos.x + glyph.width)  / page.width, (float)(pos.y + glyph.height)  / page.height});
+    cached.page = this->pages.size() - 1;
+    return cached;
+}
+
+std::string Font::get_baked_path(const std::string &cache_dir) {
+    if (!this->font_data_ptr) // Size of user-provided data is unknown
+        return "";
+    if (!this->font_hash)
+        this->font_hash = fnv1a(this->font_data_ptr, this->font_data_size);
+    float scale = this->font_scale;
+    std::uint32_t scale_bits;
+    std::memcpy(&scale_bits, &scale, sizeof(scale_bits));
+    char name[0x40];
+    std::snprintf(name, sizeof(name), "%016lx-%08x.cmwf", (unsigned long)this->font_hash, scale_bits);
+    return cache_dir + name;
+}
+
+bool Font::load_baked(const std::string &path) {
+    if (!this->baked.open(path))
+        return false;
+
+    auto *base = this->baked.data();
+    auto size  = this->baked.size();
+    auto fail  = [this, &path](const char *reason) {
+        CMW_WARN("Ignoring baked font %s: %s\n", path.c_str(), reason);
+        this->baked.close();
+        return false;
+    };
+
+    if (size < sizeof(BakedHeader))
+        return fail("truncated");
+    auto *header = reinterpret_cast<const BakedHeader *>(base);
+    if ((header->magic != baked_magic) || (header->version != baked_version))
+        return fail("bad magic or version");
+    if ((header->font_hash != this->font_hash) || (header->scale != this->font_scale)
+            || (header->first_cached != this->first_cached) || (header->last_cached != this->last_cached))
+        return fail("stale");
+
+    // Counts are untrusted, check them against the size before forming any pointer
+    std::uint64_t tables_size = (std::uint64_t)header->nb_pages * sizeof(BakedPage)
+        + (std::uint64_t)header->nb_glyphs * sizeof(BakedGlyph)
+        + (std::uint64_t)header->nb_kern_pairs * sizeof(BakedKernPair);
+    if (tables_size > size - sizeof(BakedHeader))
+        return fail("truncated");
+
+    auto *pages  = reinterpret_cast<const BakedPage     *>(header + 1);
+    auto *glyphs = reinterpret_cast<const BakedGlyph    *>(pages  + header->nb_pages);
+    auto *kerns  = reinterpret_cast<const BakedKernPair *>(glyphs + header->nb_glyphs);
+    for (std::size_t i = 0; i < header->nb_pages; ++i) {
+        if ((pages[i].width == 0) || (pages[i].height == 0))
+            return fail("empty page");
+        if ((pages[i].offset > size) || ((std::uint64_t)pages[i].width * pages[i].height > size - pages[i].offset))
+            return fail("truncated");
+    }
+    for (std::size_t i = 0; i < header->nb_glyphs; ++i)
+        if (glyphs[i].page >= header->nb_pages)
+            return fail("bad glyph page");
+
+    this->ascender = header->ascender, this->descender = header->descender, this->linegap = header->linegap;
+
+    // Pixel data is uploaded straight from the mapping
+    std::size_t first_page = this->pages.size();
+    for (std::size_t i = 0; i < header->nb_pages; ++i) {
+        auto &page = create_page(pages[i].width, pages[i].height, (void *)(base + pages[i].offset));
+        page.cursor_x = pages[i].cursor_x, page.cursor_y = pages[i].cursor_y, page.shelf_height = pages[i].shelf_height;
+    }
+
+    for (std::size_t i = 0; i < header->nb_glyphs; ++i) {
+        const auto &g = glyphs[i];
+        auto &page = this->pages[first_page + g.page];
+        auto &glyph = this->cached_glyphs.try_emplace(g.codepoint,
+            g.codepoint, g.idx, g.x1, g.y1, g.x2, g.y2, g.advance, g.bearing).first->second;
+        glyph.set_location(page.texture.get(),
+            {(float) g.x                    / page.width, (float) g.y                    / page.height},
+            {(float)(g.x + glyph.get_width()) / page.width, (float)(g.y + glyph.get_height()) / page.height});
+        glyph.page = first_page + g.page;
+    }
+
+    if (header->has_kerning)
+        this->baked_kern_pairs = kerns, this->nb_baked_kern_pairs = header->nb_kern_pairs;
+
+    this->preloaded = true;
+    this->preload_stats.nb_glyphs = header->nb_glyphs;
+    this->preload_stats.nb_pages  = this->pages.size();
+    return true;
+}
+
+bool Font::save_baked(const std::string &path) {
+    std::vector<BakedPage> pages;
+    std::vector<BakedGlyph> glyphs;
+    std::vector<BakedKernPair> kerns;
+
+    // Only pages produced by the preload carry staging data, lazily cached glyphs are not baked
+    std::vector<std::size_t> page_map(this->pages.size(), -1);
+    for (std::size_t i = 0; i < this->pages.size(); ++i) {
+        auto &page = this->pages[i];
+        if (page.staging.empty())
+            continue;
+        page_map[i] = pages.size();
+        pages.push_back({(std::uint32_t)page.width, (std::uint32_t)page.height, 0,
+            page.cursor_x, page.cursor_y, page.shelf_height, 0});
+    }
+    if (pages.empty())
+        return false;
+
+    for (auto &[chr, glyph]: this->cached_glyphs) {
+        auto it = std::find_if(this->pages.begin(), this->pages.end(),
+            [&glyph = glyph](const auto &page) { return page.texture.get() == glyph.texture; });
+        std::size_t page_idx = it - this->pages.begin();
+        if ((it == this->pages.end()) || (page_map[page_idx] == (std::size_t)-1))
+            continue;
+        glyphs.push_back({(std::uint32_t)chr, (std::uint32_t)page_map[page_idx], glyph.idx,
+            (std::int32_t)(glyph.uv_min.x * it->width + 0.5f), (std::int32_t)(glyph.uv_min.y * it->height + 0.5f),
+            glyph.x1, glyph.y1, glyph.x2, glyph.y2, glyph.advance, glyph.bearing});
+    }
+
+    bool has_kerning = glyphs.size() <= baked_max_kerning_glyphs;
+    if (has_kerning) {
+        for (const auto &lhs: glyphs)
+            for (const auto &rhs: glyphs)
+                if (int kern = stbtt_GetGlyphKernAdvance(&this->font_ctx, lhs.idx, rhs.idx); kern)
+                    kerns.push_back({lhs.codepoint, rhs.codepoint, kern});
+        std::sort(kerns.begin(), kerns.end(), [](const auto &lhs, const auto &rhs) {
+            return std::pair{lhs.first, lhs.second} < std::pair{rhs.first, rhs.second};
+        });
+    }
+
+    BakedHeader header = {
+        baked_magic, baked_version, this->font_hash, this->font_scale,
+        this->ascender, this->descender, this->linegap,
+        this->first_cached, this->last_cached,
+        (std::uint32_t)pages.size(), (std::uint32_t)glyphs.size(), (std::uint32_t)kerns.size(),
+        has_kerning,
+    };
+
+    std::uint64_t offset = sizeof(header) + pages.size() * sizeof(BakedPage)
+        + glyphs.size() * sizeof(BakedGlyph) + kerns.size() * sizeof(BakedKernPair);
+    for (auto &page: pages) {
+        offset = (offset + 0xf) & ~0xf;
+        page.offset = offset;
+        offset += page.width * page.height;
+    }
+
+    std::string tmp_path = path + ".tmp";
+    FILE *fp = fopen(tmp_path.c_str(), "wb");
+    if (!fp) {
+        CMW_WARN("Failed to create baked font %s\n", tmp_path.c_str());
+        return false;
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok &= fwrite(pages.data(),  sizeof(BakedPage),     pages.size(),  fp) == pages.size();
+    ok &= fwrite(glyphs.data(), sizeof(BakedGlyph),    glyphs.size(), fp) == glyphs.size();
+    ok &= fwrite(kerns.data(),  sizeof(BakedKernPair), kerns.size(),  fp) == kerns.size();
+    for (std::size_t i = 0, j = 0; ok && (i < this->pages.size()); ++i) {
+        if (page_map[i] == (std::size_t)-1)
+            continue;
+        auto &staging = this->pages[i].staging;
+        ok &= fseek(fp, pages[j++].offset, SEEK_SET) == 0;
+        ok &= fwrite(staging.data(), 1, staging.size(), fp) == staging.size();
+    }
+    ok &= fclose(fp) == 0;
+
+    std::remove(path.c_str());
+    if (!ok || std::rename(tmp_path.c_str(), path.c_str())) {
+        CMW_WARN("Failed to write baked font %s\n", path.c_str());
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+
+    CMW_TRACE("Baked font to %s\n", path.c_str());
+    return true;
+}
+
+void Font::release_staging() {
+    for (auto &page: this->pages) {
+        page.staging.clear();
+        page.staging.shrink_to_fit();
+    }
+}
+
+int Font::get_baked_kerning(int ch1, int ch2) const {
+    auto *end = this->baked_kern_pairs + this->nb_baked_kern_pairs;
+    auto *it  = std::lower_bound(this->baked_kern_pairs, end, std::pair{(std::uint32_t)ch1, (std::uint32_t)ch2},
+        [](const BakedKernPair &pair, const auto &key) { return std::pair{pair.first, pair.second} < key; });
+    return ((it != end) && (it->first == (std::uint32_t)ch1) && (it->second == (std::uint32_t)ch2)) ? it->advance : 0;
 }
 
-Glyph &Font::get_glyph(char16_t chr) {
+Glyph &Font::get_glyph(char32_t chr) {
     auto it = this->cached_glyphs.find(chr);
     if (it != this->cached_glyphs.end())
-        return it->second;
+        return use_glyph(it->second);
     return cache_glyph(chr);
 }
 
+std::size_t Font::get_nb_resident_pages() const {
+    return std::count_if(this->pages.begin(), this->pages.end(),
+        [](const auto &page) { return page.texture != nullptr; });
+}
+
+std::size_t Font::get_vram_usage() const {
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < this->pages.size(); ++i)
+        size += get_page_vram(i);
+    return size;
+}
+
+std::size_t Font::get_ram_usage() const {
+    std::size_t size = this->baked.size();
+    for (std::size_t i = 0; i < this->pages.size(); ++i)
+        size += get_page_ram(i);
+    return size;
+}
+
+std::size_t Font::evict_page(std::size_t idx) {
+    auto &page = this->pages[idx];
+    if (!page.texture)
+        return 0;
+
+    std::size_t freed = get_page_vram(idx) + get_page_ram(idx);
+    CMW_TRACE("Evicting atlas page %zu (%dx%d)\n", idx, page.width, page.height);
+    for (auto &[chr, glyph]: this->cached_glyphs)
+        if (glyph.texture == page.texture.get())
+            glyph.texture = nullptr;
+    page.texture.reset();
+    page.staging.clear();
+    page.staging.shrink_to_fit();
+    ++eviction_epoch;
+    return freed;
+}
+
+void TextLayout::clear() {
+    this->glyphs.clear();
+    this->runs.clear();
+    this->lines.clear();
+    this->width = this->height = 0.0f;
+}
+
+void TextLayout::begin(Font *font, float scale) {
+    clear();
+    this->scale = scale;
+    this->default_font = font;
+    this->lines.emplace_back();
+    this->last_font = nullptr, this->last_codepoint = 0;
+    this->pen_x = 0.0f;
+    this->line_first = this->break_glyph = 0;
+    this->break_x = this->break_width = 0.0f;
+}
+
+void TextLayout::new_line() {
+    this->lines.emplace_back();
+    this->last_font = nullptr, this->last_codepoint = 0;
+    this->pen_x = 0.0f;
+    this->line_first = this->break_glyph = this->glyphs.size();
+    this->break_x = this->break_width = 0.0f;
+}
+
+void TextLayout::place_glyph(Font &font, Glyph &glyph, float scale, float max_width) {
+    char32_t chr = glyph.get_codepoint();
+    if ((this->last_font == &font) && this->last_codepoint)
+        this->pen_x += font.get_kerning(this->last_codepoint, chr) * scale;
+
+    float advance = glyph.get_advance() * scale;
+    if ((max_width > 0.0f) && (chr != U' ') && (this->pen_x > 0.0f) && (this->pen_x + advance > max_width)) {
+        if (this->break_glyph > this->line_first) {
+            // Move the glyphs following the last space to the next line
+            std::size_t first = this->break_glyph;
+            float shift = this->break_x, pen = this->pen_x - shift;
+            this->lines.back().width = this->break_width;
+            new_line();
+            for (auto it = this->glyphs.begin() + first; it != this->glyphs.end(); ++it)
+                it->pos.x -= shift, it->line = this->lines.size() - 1;
+            this->line_first = this->break_glyph = first;
+            this->pen_x = pen;
+        } else {
+            new_line();
+        }
+    }
+
+    this->last_font = &font, this->last_codepoint = chr;
+    if (!this->default_font)
+        this->default_font = &font;
+
+    if (chr == U' ') { // Spaces are break opportunities and don't produce geometry
+        this->break_width = this->lines.back().width;
+        this->pen_x      += advance;
+        this->break_glyph = this->glyphs.size(), this->break_x = this->pen_x;
+        return;
+    }
+
+    if (glyph.get_width() && glyph.get_height())
+        this->glyphs.push_back({&glyph, &font, {this->pen_x, 0.0f}, (std::uint32_t)(this->lines.size() - 1)});
+    this->pen_x += advance;
+    this->lines.back().width = std::max(this->lines.back().width, this->pen_x);
+}
+
+void TextLayout::finish() {
+    // Line metrics are the extremes of the fonts used on the line, empty lines use the default font
+    for (auto &line: this->lines)
+        line.ascender = line.descender = line.linegap = 0.0f, line.count = 0;
+
+    auto merge_metrics = [scale = this->scale](TextLayout::Line &line, const Font &font) {
+        line.ascender  = std::max(line.ascender,  font.get_ascender()  * scale);
+        line.descender = std::min(line.descender, font.get_descender() * scale);
+        line.linegap   = std::max(line.linegap,   font.get_linegap()   * scale);
+    };
+
+    for (std::size_t i = 0; i < this->glyphs.size(); ++i) {
+        auto &glyph = this->glyphs[i];
+        auto &line  = this->lines[glyph.line];
+        if (!line.count++)
+            line.first = i;
+        merge_metrics(line, *glyph.font);
+
+        if (this->runs.empty() || (this->runs.back().font != glyph.font) || (this->runs.back().line != glyph.line))
+            this->runs.push_back({glyph.font, glyph.line, i, 0});
+        ++this->runs.back().count;
+    }
+
+    float baseline = 0.0f;
+    for (std::size_t i = 0; i < this->lines.size(); ++i) {
+        auto &line = this->lines[i];
+        if (!line.count) {
+            line.first = (i == 0) ? 0 : this->lines[i - 1].first + this->lines[i - 1].count;
+            if (this->default_font)
+                merge_metrics(line, *this->default_font);
+        }
+        if (i != 0) {
+            auto &prev = this->lines[i - 1];
+            baseline -= -prev.descender + prev.linegap + line.ascender;
+        }
+        line.baseline = baseline;
+        this->width = std::max(this->width, line.width);
+    }
+
+    for (auto &glyph: this->glyphs)
+        glyph.pos.y = this->lines[glyph.line].baseline;
+
+    this->height = this->lines.front().ascender - (this->lines.back().baseline + this->lines.back().descender);
+}
+
 } // namespace cmw
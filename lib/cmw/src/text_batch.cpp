@@ -0,0 +1,103 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstdint>
+#include <algorithm>
+
+#include "cmw/core/text.hpp"
+#include "cmw/utils/unicode.hpp"
+
+#include "cmw/core/text_batch.hpp"
+
+namespace cmw {
+
+template <typename Str>
+void TextBatch::add_impl(Str str, const Position &pos, float scale, const Colorf &color, Font *font, float max_width) {
+    auto font_idx = get_font_idx(font);
+    std::size_t first = this->codepoints.size();
+
+    unicode::for_each_codepoint(str, [&](char32_t chr) {
+        this->codepoints.push_back(chr);
+        if (chr == U'\n')
+            return;
+        if (auto &resolved = lookup(font_idx, chr); !resolved.known) {
+            resolved.known = true;
+            this->pending.push_back((std::uint64_t)font_idx << 32 | chr);
+        }
+    });
+
+    this->entries.push_back({first, this->codepoints.size() - first, pos, scale, color, font_idx, max_width});
+    this->built = false;
+}
+
+void TextBatch::add(std::u16string_view str, const Position &pos, float scale, const Colorf &color, Font *font, float max_width) {
+    add_impl(str, pos, scale, color, font, max_width);
+}
+
+void TextBatch::add(std::string_view str, const Position &pos, float scale, const Colorf &color, Font *font, float max_width) {
+    add_impl(str, pos, scale, color, font, max_width);
+}
+
+void TextBatch::clear() {
+    this->codepoints.clear();
+    this->entries.clear();
+    this->quads.clear();
+    this->pages.clear();
+    this->built = false;
+}
+
+void TextBatch::reset() {
+    clear();
+    this->fonts = {nullptr};
+    this->ascii = {AsciiTable{}};
+    this->resolved.clear();
+    this->pending.clear();
+}
+
+std::uint32_t TextBatch::get_font_idx(Font *font) {
+    auto it = std::find(this->fonts.begin(), this->fonts.end(), font);
+    if (it != this->fonts.end())
+        return it - this->fonts.begin();
+    this->fonts.push_back(font);
+    this->ascii.emplace_back();
+    return this->fonts.size() - 1;
+}
+
+void TextBatch::build() {
+    this->quads.clear();
+    this->pages.clear();
+    for (const auto &entry: this->entries) {
+        std::u32string_view str(this->codepoints.data() + entry.first, entry.count);
+        this->layout.build_with(this->fonts[entry.font_idx], str, [&](char32_t chr) -> std::pair<Font *, Glyph *> {
+            auto *resolved = find(entry.font_idx, chr);
+            return resolved ? std::pair{resolved->font, resolved->glyph} : std::pair<Font *, Glyph *>{nullptr, nullptr};
+        }, entry.scale, entry.max_width);
+
+        for (const auto &glyph: this->layout.get_glyphs()) {
+            Position pos = {entry.pos.x + glyph.pos.x, entry.pos.y + glyph.pos.y, entry.pos.z};
+            this->quads.push_back({&glyph.glyph->get_texture(), make_quad(*glyph.glyph, pos, entry.scale), entry.color});
+            if (std::pair page{glyph.font, glyph.glyph->get_page()}; this->pages.empty() || (this->pages.back() != page))
+                this->pages.push_back(page);
+        }
+    }
+    std::sort(this->pages.begin(), this->pages.end());
+    this->pages.erase(std::unique(this->pages.begin(), this->pages.end()), this->pages.end());
+    this->built_epoch = this->resolved_epoch;
+    this->built = true;
+}
+
+} // namespace cmw
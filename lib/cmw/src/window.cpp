@@ -22,6 +22,7 @@
 #include <GLFW/glfw3.h>
 
 #include "cmw/core/window.hpp"
+#include "cmw/gl/extensions.hpp"
 
 namespace cmw {
 
@@ -40,6 +41,7 @@ Window::Window(int w, int h, const std::string &name, int x, int y, GLboolean re
 
     CMW_TRY_THROW(gladLoadGLLoader((GLADloadproc)glfwGetProcAddress),
         std::runtime_error("Failed to initialize glad"));
+    gl::load_extensions((GLADloadproc)glfwGetProcAddress);
 
     this->input_manager.set_window(get_window());
 }
@@ -1,6 +1,7 @@
 #version 430 core
 
-#define MAX_TEXTURES 30
+#define MAX_TEXTURES        30
+#define MAX_TEXTURE_ARRAYS  2
 
 #define MODE_DEFAULT    0
 #define MODE_ALPHAMAP   1
@@ -10,15 +11,23 @@ in DATA {
    vec4 blend_color;
    flat int tex_idx;
    flat uint mode;
+   flat int layer;
 } f_in;
 
 out vec4 color;
 
-uniform sampler2D u_textures[MAX_TEXTURES];
+uniform sampler2D      u_textures[MAX_TEXTURES];
+uniform sampler2DArray u_texture_arrays[MAX_TEXTURE_ARRAYS];
+
+vec4 sample_texture() {
+    if (f_in.layer >= 0)
+        return texture(u_texture_arrays[f_in.tex_idx], vec3(f_in.uv, f_in.layer));
+    return texture(u_textures[f_in.tex_idx], f_in.uv);
+}
 
 void main() {
     if (f_in.mode == MODE_ALPHAMAP)
-        color = vec4(f_in.blend_color.rgb, texture(u_textures[f_in.tex_idx], f_in.uv).r);
+        color = vec4(f_in.blend_color.rgb, sample_texture().r);
     else
-        color = texture(u_textures[f_in.tex_idx], f_in.uv) * f_in.blend_color;
+        color = sample_texture() * f_in.blend_color;
 }
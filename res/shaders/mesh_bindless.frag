@@ -0,0 +1,37 @@
+#version 430 core
+#extension GL_ARB_bindless_texture : require
+
+#define MAX_TEXTURE_ARRAYS  2
+
+#define MODE_DEFAULT    0
+#define MODE_ALPHAMAP   1
+
+in DATA {
+   vec2 uv;
+   vec4 blend_color;
+   flat int tex_idx;
+   flat uint mode;
+   flat int layer;
+} f_in;
+
+out vec4 color;
+
+// Texture handles of the batch, indexed by tex_idx
+layout (std430, binding = 0) readonly buffer Textures {
+    uvec2 u_handles[];
+};
+
+uniform sampler2DArray u_texture_arrays[MAX_TEXTURE_ARRAYS];
+
+vec4 sample_texture() {
+    if (f_in.layer >= 0)
+        return texture(u_texture_arrays[f_in.tex_idx], vec3(f_in.uv, f_in.layer));
+    return texture(sampler2D(u_handles[f_in.tex_idx]), f_in.uv);
+}
+
+void main() {
+    if (f_in.mode == MODE_ALPHAMAP)
+        color = vec4(f_in.blend_color.rgb, sample_texture().r);
+    else
+        color = sample_texture() * f_in.blend_color;
+}
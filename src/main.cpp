@@ -16,6 +16,7 @@
 // along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <string>
+#include <string_view>
 #include <memory>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -40,7 +41,7 @@ extern "C" void __libnx_exception_handler(ThreadExceptionDump *ctx) {
 
 constexpr int window_w = 1280, window_h = 720;
 
-int main() {
+int main(int argc, char **argv) {
 #ifdef CMW_SWITCH
     CMW_TRY_RC_RETURN(romfsInit());
     CMW_SCOPE_GUARD([]() { romfsExit(); });
@@ -52,6 +53,16 @@ int main() {
     CMW_INFO("Starting\n");
 
     app->get_window().set_vsync(true);
+
+    // --record <log> captures the input of the session, --replay <log> plays it back with a fixed timestep
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (std::string_view(argv[i]) == "--record") {
+            app->get_window().get_input_manager().start_recording(argv[++i]);
+        } else if (std::string_view(argv[i]) == "--replay") {
+            if (app->get_window().get_input_manager().start_replay(argv[++i]))
+                app->set_fixed_timestep(1.0f / 60.0f);
+        }
+    }
     app->get_window().set_viewport(window_w, window_h);
 
     glEnable(GL_DEBUG_OUTPUT);
@@ -80,14 +91,19 @@ int main() {
     app->get_resource_manager().load_font("fonts/FontNintendoExtended.ttf");
 #endif
     auto *comic_sans = app->get_resource_manager().load_font("fonts/comic.ttf");
+    app->get_resource_manager().preload_fonts();
 
     app->get_renderer().set_clear_color({0.18f, 0.20f, 0.25f, 1.0f});
 
-    cmw::gl::Texture2d &cube_tex  = app->get_resource_manager().get_texture("textures/rectangle.jpg");
-    cmw::gl::Texture2d &bog_tex   = app->get_resource_manager().get_texture("textures/triangle.jpg");
+#ifdef CMW_DEBUG
+    app->get_resource_manager().enable_hot_reload();
+#endif
+
+    cmw::gl::Texture2d &cube_tex  = app->get_resource_manager().get_texture_async("textures/rectangle.jpg");
+    cmw::gl::Texture2d &bog_tex   = app->get_resource_manager().get_texture_async("textures/triangle.jpg");
     cmw::gl::Texture2d &white_tex = app->get_resource_manager().get_white_texture();
 
-    cmw::gl::ShaderProgram &cube_program = app->get_resource_manager().get_shader("shaders/cube.vert", "shaders/cube.frag");
+    cmw::gl::ShaderProgram &cube_program = app->get_resource_manager().get_shader_async("shaders/cube.vert", "shaders/cube.frag");
 
     cmw::shapes::Line line = {
         {
@@ -111,10 +127,11 @@ int main() {
         glm::vec3(+1280.0f, +  0.0f, +0.0f)
     );
 
+    using Animation = cmw::AnimationSystem;
     auto triangle = cmw::AnimatedObject<cmw::shapes::Triangle>(
-        [](auto elapsed) -> glm::mat4 {
-            return glm::rotate(glm::mat4(1.0f), (float)(elapsed.count() / 1000.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-        },
+        app->get_animations(),
+        Animation::TrackInfo{ {}, {{}, glm::vec3(1.0f), glm::two_pi<float>()}, glm::two_pi<float>(),
+            Animation::Easing::Linear, Animation::Loop::Repeat },
         std::vector<cmw::Mesh::Vertex>{
             {{+200.0f, +200.0f, +1.0f}, {0.0f, 0.0f}},
             {{+600.0f, +200.0f, +1.0f}, {1.0f, 0.0f}},
@@ -125,10 +142,9 @@ int main() {
     );
 
     auto rectangle = cmw::AnimatedObject<cmw::shapes::Rectangle>(
-        [](auto elapsed) -> glm::mat4 {
-            float scale = glm::sin((float)(elapsed.count() / 1000.0f)) / 2.0f + 1.0f;
-            return glm::scale(glm::mat4(1.0f), glm::vec3(scale));
-        },
+        app->get_animations(),
+        Animation::TrackInfo{ {{}, glm::vec3(0.5f)}, {{}, glm::vec3(1.5f)}, glm::pi<float>(),
+            Animation::Easing::InOutSine, Animation::Loop::PingPong },
         std::vector<cmw::Mesh::Vertex>{
             {{+ 800.0f, +400.0f, -1.0f}, {0.0f, 0.0f}},
             {{+1000.0f, +400.0f, -1.0f}, {1.0f, 0.0f}},
@@ -186,17 +202,18 @@ int main() {
         CMW_TRACE("Animation: %ldms elapsed\n", elapsed.count());
     });
 
-    float t, dt, last_time = app->get_time<float>();
+    float dt;
     cmw::Colorf text_color{cmw::colors::Red};
     while (!app->get_window().get_should_close()) {
+        dt = app->begin_frame();
+        app->get_resource_manager().process_reloads();
+        app->get_resource_manager().process_uploads();
+        app->get_resource_manager().process_shaders();
         app->get_renderer().clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         if (anim)
             anim.update();
 
-        t = app->get_time<float>();
-        dt = t - last_time, last_time = t;
-
         cmw::gl::Texture2d::active(0);
         cube_tex.bind();
         cube_vao.bind();
@@ -204,7 +221,7 @@ int main() {
 
         for (std::size_t i = 0; i < 10; ++i) {
             glm::mat4 model = glm::translate(glm::mat4(1.0f), cube_params[i].pos);
-            model = glm::rotate(model, (float)glfwGetTime(), cube_params[i].rot_axis);
+            model = glm::rotate(model, app->get_time<float>(), cube_params[i].rot_axis);
             cube_program.set_value("model", model);
             glDrawArrays(GL_TRIANGLES, 0, 36);
         }
@@ -235,16 +252,27 @@ int main() {
         ImGui::SetNextWindowPos(ImVec2(900, 10), ImGuiCond_Once);
         ImGui::Begin("Debug panel", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
         ImGui::Text("%#.2f fps", ImGui::GetIO().Framerate);
+        auto usage = app->get_resource_manager().get_memory_usage();
+        ImGui::Text("%zu resources, %.1fMiB VRAM, %.1fMiB RAM", usage.nb_resources, usage.vram / 1048576.0f, usage.ram / 1048576.0f);
         ImGui::Separator();
 
         ImGui::ColorEdit3("Clear color", (float *)&app->get_renderer().get_clear_color(), ImGuiColorEditFlags_PickerHueWheel);
         ImGui::ColorEdit3("Text color",  (float *)&text_color,  ImGuiColorEditFlags_PickerHueWheel);
 
+        if (bool bindless = app->get_renderer().is_bindless(); ImGui::Checkbox("Bindless textures", &bindless))
+            app->get_renderer().set_bindless(bindless);
+
+        if (bool paused = app->get_clock().is_paused(); ImGui::Checkbox("Pause", &paused))
+            app->get_clock().set_paused(paused);
+        if (float scale = app->get_clock().get_time_scale(); ImGui::SliderFloat("Time scale", &scale, 0.0f, 4.0f))
+            app->get_clock().set_time_scale(scale);
+
         ImGui::End();
 #endif
 
         cmw::imgui::end_frame();
         app->get_window().update();
+        app->get_resource_manager().collect();
     }
 
     CMW_INFO("Exiting\n");
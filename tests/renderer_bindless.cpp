@@ -0,0 +1,107 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <array>
+#include <memory>
+#include <vector>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <cmw.hpp>
+
+// Checks the fallback to texture units when bindless textures are unavailable
+// Run from the repository root, so that the assets are found
+
+#define CHECK(cond) do {                                                    \
+    if (!(cond)) {                                                          \
+        std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);  \
+        std::exit(1);                                                       \
+    }                                                                       \
+} while (0)
+
+constexpr int cell_size = 8, nb_cols = 8;
+constexpr int nb_textures = 2 * cmw::Renderer::max_textures + 5; // Forces two flushes on texture exhaustion
+constexpr int window_w = nb_cols * cell_size, window_h = (nb_textures + nb_cols - 1) / nb_cols * cell_size;
+
+static std::array<std::uint8_t, 3> get_color(int idx) {
+    return {(std::uint8_t)(3 * idx + 1), (std::uint8_t)(250 - 3 * idx), (std::uint8_t)(idx % 2 ? 40 : 200)};
+}
+
+int main() {
+    cmw::log::initialize();
+    glfwInit();
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    cmw::Window window(window_w, window_h, "renderer_bindless");
+    cmw::gl::ext::bindless_texture = false; // Behave like a driver without GL_ARB_bindless_texture
+
+    {
+        cmw::ResourceManager resource_manager;
+        cmw::Renderer renderer(resource_manager);
+
+        CHECK(!renderer.set_bindless(true));
+        CHECK(!renderer.is_bindless());
+
+        std::vector<std::unique_ptr<cmw::gl::Texture2d>> textures;
+        for (int i = 0; i < nb_textures; ++i) {
+            auto color = get_color(i);
+            auto &texture = *textures.emplace_back(std::make_unique<cmw::gl::Texture2d>());
+            texture.bind();
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            texture.set_data(color.data(), 1, 1, GL_RGB8, GL_RGB);
+            texture.set_parameters(std::pair{GL_TEXTURE_MIN_FILTER, GL_NEAREST}, std::pair{GL_TEXTURE_MAG_FILTER, GL_NEAREST});
+        }
+
+        // Drawn offscreen, since the contents of a hidden window are undefined
+        cmw::gl::Texture2d target;
+        target.bind();
+        target.set_data(nullptr, window_w, window_h, GL_RGBA8, GL_RGBA);
+        cmw::gl::Framebuffer framebuffer;
+        framebuffer.bind();
+        framebuffer.attach(target);
+        CHECK(framebuffer.is_complete());
+        glViewport(0, 0, window_w, window_h);
+
+        while (glGetError() != GL_NO_ERROR) // Only check the errors of the draws
+            ;
+
+        cmw::OrthographicCamera camera = {0.0f, (float)window_w, 0.0f, (float)window_h, -10.0f, 10.0f};
+        renderer.clear(GL_COLOR_BUFFER_BIT, {0.0f, 0.0f, 0.0f, 1.0f});
+        renderer.begin(camera, 0.0f);
+        for (int i = 0; i < nb_textures; ++i)
+            renderer.draw_texture(*textures[i], {(float)(i % nb_cols * cell_size), (float)(i / nb_cols * cell_size), 0.0f},
+                cell_size, cell_size);
+        renderer.end();
+        glFinish();
+        CHECK(glGetError() == GL_NO_ERROR);
+
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        for (int i = 0; i < nb_textures; ++i) {
+            std::uint8_t pixel[3];
+            glReadPixels(i % nb_cols * cell_size + cell_size / 2, i / nb_cols * cell_size + cell_size / 2, 1, 1,
+                GL_RGB, GL_UNSIGNED_BYTE, pixel);
+            auto color = get_color(i);
+            for (int c = 0; c < 3; ++c)
+                CHECK(std::abs(pixel[c] - color[c]) <= 2);
+        }
+    }
+
+    std::printf("renderer_bindless: ok\n");
+    cmw::log::finalize();
+    return 0;
+}
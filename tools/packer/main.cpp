@@ -0,0 +1,165 @@
+// Copyright (C) 2019 averne
+//
+// This file is part of cemowy.
+//
+// cemowy is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// cemowy is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with cemowy.  If not, see <http://www.gnu.org/licenses/>.
+
+// Packs a directory into an asset archive readable by cmw::ArchiveSource
+// Usage: cmw-pack [-c none|lz4] [-a alignment] <input directory> <output archive>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "cmw/core/asset_source.hpp"
+#include "cmw/utils/lz4.hpp"
+#include "cmw/utils/mapped_file.hpp"
+
+namespace fs = std::filesystem;
+using Archive = cmw::ArchiveSource;
+
+struct Input {
+    std::string name;
+    fs::path path;
+    Archive::Entry entry;
+};
+
+static void usage(const char *argv0) {
+    std::fprintf(stderr, "Usage: %s [-c none|lz4] [-a alignment] <input directory> <output archive>\n", argv0);
+    std::exit(1);
+}
+
+int main(int argc, char **argv) {
+    auto compression = Archive::Compression::Lz4;
+    std::uint32_t alignment = 16;
+
+    int i = 1;
+    for (; (i < argc) && (argv[i][0] == '-'); ++i) {
+        if (!std::strcmp(argv[i], "-c") && (i + 1 < argc)) {
+            std::string mode = argv[++i];
+            if      (mode == "none") compression = Archive::Compression::None;
+            else if (mode == "lz4")  compression = Archive::Compression::Lz4;
+            else                     usage(argv[0]);
+        } else if (!std::strcmp(argv[i], "-a") && (i + 1 < argc)) {
+            alignment = std::strtoul(argv[++i], nullptr, 0);
+            if (!alignment || (alignment & (alignment - 1)))
+                usage(argv[0]);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if (argc - i != 2)
+        usage(argv[0]);
+    fs::path root = argv[i], out_path = argv[i + 1];
+
+    std::vector<Input> inputs;
+    std::error_code ec;
+    for (auto &it: fs::recursive_directory_iterator(root, ec)) {
+        if (!it.is_regular_file() || (it.path().extension() == ".cmwa")) // Don't pack previous archives
+            continue;
+        auto name = it.path().lexically_relative(root).generic_string();
+        inputs.push_back({name, it.path(), {Archive::hash_path(name)}});
+    }
+    if (ec) {
+        std::fprintf(stderr, "Failed to list %s: %s\n", root.c_str(), ec.message().c_str());
+        return 1;
+    }
+
+    std::sort(inputs.begin(), inputs.end(), [](const Input &a, const Input &b) {
+        return (a.entry.hash != b.entry.hash) ? a.entry.hash < b.entry.hash : a.name < b.name;
+    });
+    for (std::size_t j = 1; j < inputs.size(); ++j) {
+        if (inputs[j].entry.hash == inputs[j - 1].entry.hash)
+            std::fprintf(stderr, "Warning: hash collision between %s and %s\n",
+                inputs[j - 1].name.c_str(), inputs[j].name.c_str());
+    }
+
+    // Names table
+    std::string names;
+    for (auto &input: inputs) {
+        input.entry.name_offset = names.size(), input.entry.name_size = input.name.size();
+        names += input.name;
+    }
+
+    auto align = [alignment](std::uint64_t off) { return (off + alignment - 1) & ~(std::uint64_t)(alignment - 1); };
+
+    Archive::Header header = {
+        Archive::magic, Archive::version,
+        (std::uint32_t)inputs.size(), alignment,
+        sizeof(Archive::Header) + inputs.size() * sizeof(Archive::Entry), names.size(),
+    };
+
+    // Blobs
+    std::vector<std::uint8_t> blobs, compressed;
+    std::uint64_t blobs_offset = align(header.names_offset + header.names_size);
+    std::uint64_t total_size = 0;
+    for (auto &input: inputs) {
+        cmw::MappedFile file(input.path.string());
+        if (!file && fs::file_size(input.path)) {
+            std::fprintf(stderr, "Failed to read %s\n", input.path.c_str());
+            return 1;
+        }
+
+        auto &entry = input.entry;
+        entry.original_size = file.size();
+        entry.compression   = Archive::Compression::None;
+        const std::uint8_t *data = file.data();
+        std::size_t size = file.size();
+
+        if ((compression == Archive::Compression::Lz4) && size) {
+            compressed.clear();
+            cmw::lz4::compress(data, size, compressed);
+            if (compressed.size() < size - size / 8) // Only keep worthwhile compression, stored entries are zero-copy
+                entry.compression = Archive::Compression::Lz4, data = compressed.data(), size = compressed.size();
+        }
+
+        blobs.resize(align(blobs.size()));
+        entry.offset = blobs_offset + blobs.size(), entry.size = size;
+        blobs.insert(blobs.end(), data, data + size);
+        total_size += entry.original_size;
+
+        std::printf("  %-40s %10zu -> %10zu%s\n", input.name.c_str(), (std::size_t)entry.original_size,
+            (std::size_t)entry.size, (entry.compression == Archive::Compression::Lz4) ? " (lz4)" : "");
+    }
+
+    auto tmp_path = out_path.string() + ".tmp";
+    FILE *fp = std::fopen(tmp_path.c_str(), "wb");
+    if (!fp) {
+        std::fprintf(stderr, "Failed to open %s\n", tmp_path.c_str());
+        return 1;
+    }
+
+    std::vector<std::uint8_t> padding(blobs_offset - header.names_offset - header.names_size, 0);
+    bool ok = std::fwrite(&header, sizeof(header), 1, fp) == 1;
+    for (auto &input: inputs)
+        ok &= std::fwrite(&input.entry, sizeof(input.entry), 1, fp) == 1;
+    ok &= std::fwrite(names.data(),   1, names.size(),   fp) == names.size();
+    ok &= std::fwrite(padding.data(), 1, padding.size(), fp) == padding.size();
+    ok &= std::fwrite(blobs.data(),   1, blobs.size(),   fp) == blobs.size();
+    ok &= !std::fclose(fp);
+    if (!ok || (fs::rename(tmp_path, out_path, ec), ec)) {
+        std::fprintf(stderr, "Failed to write %s\n", out_path.c_str());
+        fs::remove(tmp_path, ec);
+        return 1;
+    }
+
+    std::printf("Packed %zu files (%zu bytes) into %s (%zu bytes)\n", inputs.size(), (std::size_t)total_size,
+        out_path.c_str(), (std::size_t)(blobs_offset + blobs.size()));
+    return 0;
+}